@@ -0,0 +1,117 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Single allocation holding the per-channel buffers of a device.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+//============================================================================
+/* Bump allocator over one 64-byte aligned block. Each layout starts with begin(), which zeroes the block, then takes
+ * its arrays in order; every array starts on its own cache line. The block only grows, so reopening a device with the
+ * same or fewer channels and frames does not allocate, and it is freed with its owner.
+ * Not thread safe: only lay out while the device is stopped.
+ */
+class ASIOBufferArena {
+public:
+	static constexpr size_t alignment = 64;
+
+	ASIOBufferArena() = default;
+	ASIOBufferArena(const ASIOBufferArena &) = delete;
+	ASIOBufferArena &operator=(const ASIOBufferArena &) = delete;
+	~ASIOBufferArena() { release(); }
+
+	/* bytes taken by count objects of type T, padded to a cache line */
+	template<class T> static constexpr size_t footprint(size_t count)
+	{
+		return (count * sizeof(T) + alignment - 1) & ~(alignment - 1);
+	}
+
+	/* Starts a layout of at most bytes; pointers taken before are invalid afterwards. Returns false on allocation
+	 * failure, in which case take() returns nullptr.
+	 */
+	bool begin(size_t bytes)
+	{
+		used = 0;
+		if (bytes > capacity) {
+			release();
+			base = (unsigned char *)allocate(bytes);
+			if (!base)
+				return false;
+			capacity = bytes;
+		}
+		if (base)
+			memset(base, 0, capacity);
+		return base != nullptr;
+	}
+
+	/* Takes count default constructed objects; T must be trivially destructible as the arena never destroys them. */
+	template<class T> T *take(size_t count) noexcept
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+		const size_t bytes = footprint<T>(count);
+		if (!base || used + bytes > capacity)
+			return nullptr;
+		T *p = (T *)(base + used);
+		for (size_t i = 0; i < count; i++)
+			new (p + i) T();
+		used += bytes;
+		return p;
+	}
+
+	void release() noexcept
+	{
+		if (base)
+			deallocate(base);
+		base = nullptr;
+		capacity = 0;
+		used = 0;
+	}
+
+	size_t size() const noexcept { return capacity; }
+
+private:
+	unsigned char *base = nullptr;
+	size_t capacity = 0;
+	size_t used = 0;
+
+	static void *allocate(size_t bytes) noexcept
+	{
+#ifdef _MSC_VER
+		return _aligned_malloc(bytes, alignment);
+#else
+		return aligned_alloc(alignment, (bytes + alignment - 1) & ~(alignment - 1));
+#endif
+	}
+
+	static void deallocate(void *p) noexcept
+	{
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+};
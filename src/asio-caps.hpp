@@ -0,0 +1,270 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Cache of the driver capabilities, so that known drivers open without being probed.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* A clock source of the driver, as ASIOClockSource without the windows types. */
+struct ASIOCachedClock {
+	long index = 0;
+	long channel = 0;
+	long group = 0;
+	bool current = false;
+	std::string name;
+};
+
+/* What probing a driver found out; a cache hit restores all of it instead. The sample types are not kept: drivers
+ * only report them once the buffers are created, which every open does anyway.
+ */
+struct ASIODriverCaps {
+	long numInputs = 0, numOutputs = 0;
+	std::vector<double> sampleRates;
+	long minBufferSize = 0, maxBufferSize = 0, preferredBufferSize = 0, bufferGranularity = 0;
+	std::vector<std::string> inputNames, outputNames;
+	long inputLatency = 0, outputLatency = 0;
+	std::vector<ASIOCachedClock> clocks;
+};
+
+//============================================================================
+/* Where the cache is kept: a file in the plugin config directory, or memory when testing. */
+class ASIOCapsFile {
+public:
+	virtual ~ASIOCapsFile() = default;
+
+	/* Returns false if there is no file yet. */
+	virtual bool read(std::string &text) = 0;
+
+	virtual bool write(const std::string &text) = 0;
+};
+
+//============================================================================
+/* Capabilities of the drivers probed so far, as text: a format line, then one block per driver, e.g.
+ *     asio-caps 1
+ *     [{8C5E0F8A-6E1C-4B0F-9A6F-5F0B1C2D3E4F}-3]
+ *     channels 2 2
+ *     rates 44100 48000
+ *     ...
+ * Blocks are keyed by the driver class id and version so that an updated driver is probed again; a file in another
+ * format is ignored and rewritten. Safe to use from several device threads.
+ */
+class ASIOCapsCache {
+public:
+	static constexpr int format = 1;
+
+	explicit ASIOCapsCache(std::unique_ptr<ASIOCapsFile> capsFile) : file(std::move(capsFile)) {}
+
+	static std::string key(const std::string &clsid, long version) { return clsid + "-" + std::to_string(version); }
+
+	/* Returns false if the driver is not cached or its entry is inconsistent. */
+	bool load(const std::string &key, ASIODriverCaps &caps)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const Entry &entry : readEntries())
+			if (entry.first == key)
+				return parse(entry.second, caps);
+		return false;
+	}
+
+	/* Adds or replaces the entry of a driver. Returns false if the file could not be written. */
+	bool store(const std::string &key, const ASIODriverCaps &caps)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<Entry> entries = readEntries();
+		bool replaced = false;
+		for (Entry &entry : entries) {
+			if (entry.first == key) {
+				entry.second = print(caps);
+				replaced = true;
+			}
+		}
+		if (!replaced)
+			entries.emplace_back(key, print(caps));
+
+		std::string text = "asio-caps " + std::to_string(format) + "\n";
+		for (const Entry &entry : entries)
+			text += "[" + entry.first + "]\n" + entry.second;
+		return file->write(text);
+	}
+
+	/* The cached capabilities of a driver, or else those bool probe(ASIODriverCaps &) finds out, cached if it
+	 * succeeds. Returns true on a cache hit, which needs as many channels as the driver has now.
+	 */
+	template<class Probe>
+	bool probeOrLoad(const std::string &key, long numInputs, long numOutputs, ASIODriverCaps &caps, Probe &&probe)
+	{
+		if (load(key, caps) && caps.numInputs == numInputs && caps.numOutputs == numOutputs)
+			return true;
+		caps = ASIODriverCaps();
+		if (probe(caps))
+			store(key, caps);
+		return false;
+	}
+
+private:
+	using Entry = std::pair<std::string, std::string>; // key, lines of the block
+
+	std::unique_ptr<ASIOCapsFile> file;
+	std::mutex mutex;
+
+	std::vector<Entry> readEntries()
+	{
+		std::vector<Entry> entries;
+		std::string text;
+		if (!file->read(text))
+			return entries;
+
+		size_t at = 0;
+		bool known = false;
+		while (at < text.size()) {
+			size_t end = text.find('\n', at);
+			if (end == std::string::npos)
+				end = text.size();
+			std::string line = text.substr(at, end - at);
+			at = end + 1;
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			if (!known) {
+				if (line != "asio-caps " + std::to_string(format))
+					return entries;
+				known = true;
+			} else if (line.size() > 2 && line.front() == '[' && line.back() == ']') {
+				entries.emplace_back(line.substr(1, line.size() - 2), std::string());
+			} else if (!entries.empty() && !line.empty()) {
+				entries.back().second += line + "\n";
+			}
+		}
+		return entries;
+	}
+
+	/* Names come last on their line, so they may hold spaces; line breaks become spaces. */
+	static std::string name(const std::string &text)
+	{
+		std::string result = text;
+		for (char &c : result)
+			if (c == '\n' || c == '\r')
+				c = ' ';
+		return result;
+	}
+
+	static std::string print(const ASIODriverCaps &caps)
+	{
+		char buf[160];
+		std::string text;
+
+		snprintf(buf, sizeof(buf), "channels %ld %ld\n", caps.numInputs, caps.numOutputs);
+		text += buf;
+		text += "rates";
+		for (double rate : caps.sampleRates) {
+			snprintf(buf, sizeof(buf), " %.17g", rate);
+			text += buf;
+		}
+		snprintf(buf, sizeof(buf), "\nbuffers %ld %ld %ld %ld\nlatencies %ld %ld\n", caps.minBufferSize,
+			 caps.maxBufferSize, caps.preferredBufferSize, caps.bufferGranularity, caps.inputLatency,
+			 caps.outputLatency);
+		text += buf;
+		for (const std::string &input : caps.inputNames)
+			text += "input " + name(input) + "\n";
+		for (const std::string &output : caps.outputNames)
+			text += "output " + name(output) + "\n";
+		for (const ASIOCachedClock &clock : caps.clocks) {
+			snprintf(buf, sizeof(buf), "clock %ld %ld %ld %d ", clock.index, clock.channel, clock.group,
+				 clock.current ? 1 : 0);
+			text += buf + name(clock.name) + "\n";
+		}
+		return text;
+	}
+
+	/* Reads the numbers at the start of text into values; returns where the next field starts, or nullptr if
+	 * fewer than count numbers were found.
+	 */
+	static const char *numbers(const char *text, long *values, int count)
+	{
+		for (int i = 0; i < count; i++) {
+			char *next;
+			values[i] = strtol(text, &next, 10);
+			if (next == text)
+				return nullptr;
+			text = next;
+		}
+		return *text == ' ' ? text + 1 : text;
+	}
+
+	static bool parse(const std::string &block, ASIODriverCaps &caps)
+	{
+		caps = ASIODriverCaps();
+		size_t at = 0;
+		while (at < block.size()) {
+			size_t end = block.find('\n', at);
+			if (end == std::string::npos)
+				end = block.size();
+			const std::string line = block.substr(at, end - at);
+			at = end + 1;
+			const size_t space = line.find(' ');
+			const std::string field = line.substr(0, space);
+			const char *rest = space == std::string::npos ? "" : line.c_str() + space + 1;
+			long v[4];
+
+			if (field == "channels" && numbers(rest, v, 2)) {
+				caps.numInputs = v[0];
+				caps.numOutputs = v[1];
+			} else if (field == "rates") {
+				char *next;
+				for (double rate = strtod(rest, &next); next != rest; rate = strtod(rest, &next)) {
+					caps.sampleRates.push_back(rate);
+					rest = next;
+				}
+			} else if (field == "buffers" && numbers(rest, v, 4)) {
+				caps.minBufferSize = v[0];
+				caps.maxBufferSize = v[1];
+				caps.preferredBufferSize = v[2];
+				caps.bufferGranularity = v[3];
+			} else if (field == "latencies" && numbers(rest, v, 2)) {
+				caps.inputLatency = v[0];
+				caps.outputLatency = v[1];
+			} else if (field == "input") {
+				caps.inputNames.push_back(rest);
+			} else if (field == "output") {
+				caps.outputNames.push_back(rest);
+			} else if (field == "clock") {
+				const char *clockName = numbers(rest, v, 4);
+				if (!clockName)
+					return false;
+				ASIOCachedClock clock;
+				clock.index = v[0];
+				clock.channel = v[1];
+				clock.group = v[2];
+				clock.current = v[3] != 0;
+				clock.name = clockName;
+				caps.clocks.push_back(clock);
+			} else {
+				return false;
+			}
+		}
+		return caps.numInputs + caps.numOutputs > 0 && caps.preferredBufferSize > 0 &&
+		       !caps.sampleRates.empty() && (long)caps.inputNames.size() == caps.numInputs &&
+		       (long)caps.outputNames.size() == caps.numOutputs;
+	}
+};
@@ -0,0 +1,1034 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * SIMD sample format conversion kernels used by the ASIO device callback.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include "byteorder.h"
+#include "asio-types.h"
+
+/* MSVC lets us use any intrinsic without compiler flags; gcc & clang need the target attribute on each kernel. */
+#if defined(__GNUC__) || defined(__clang__)
+#define ASIO_TARGET(isa) __attribute__((target(isa)))
+#else
+#define ASIO_TARGET(isa)
+#endif
+
+//============================================================================
+/* Instruction sets available on the running cpu, probed once. */
+struct ASIOCpuFeatures {
+	bool sse2 = false, ssse3 = false, avx = false, avx2 = false, fma = false;
+
+	static const ASIOCpuFeatures &get() noexcept
+	{
+		static const ASIOCpuFeatures features = detect();
+		return features;
+	}
+
+private:
+	static void cpuid(int leaf, int subleaf, unsigned int regs[4]) noexcept
+	{
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, leaf, subleaf);
+		for (int i = 0; i < 4; i++)
+			regs[i] = (unsigned int)r[i];
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	static uint64_t xgetbv0() noexcept
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return ((uint64_t)hi << 32) | lo;
+#endif
+	}
+
+	static ASIOCpuFeatures detect() noexcept
+	{
+		ASIOCpuFeatures f;
+		unsigned int regs[4] = {};
+		cpuid(0, 0, regs);
+		const unsigned int maxLeaf = regs[0];
+		if (maxLeaf < 1)
+			return f;
+
+		cpuid(1, 0, regs);
+		f.sse2 = (regs[3] & (1u << 26)) != 0;
+		f.ssse3 = (regs[2] & (1u << 9)) != 0;
+		// the os must save the ymm registers on context switches for avx to be usable
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		const bool ymmSaved = osxsave && (xgetbv0() & 6) == 6;
+		f.avx = ymmSaved && (regs[2] & (1u << 28)) != 0;
+		f.fma = f.avx && (regs[2] & (1u << 12)) != 0;
+
+		if (maxLeaf >= 7) {
+			cpuid(7, 0, regs);
+			f.avx2 = f.avx && (regs[1] & (1u << 5)) != 0;
+		}
+		return f;
+	}
+};
+
+/* Converts numSamples interleaved-by-stride device samples at src into planar floats at dest. */
+typedef void (*ASIOConvertToFloatFn)(const void *src, float *dest, int numSamples);
+/* Converts numSamples planar floats at src into device samples at dest. */
+typedef void (*ASIOConvertFromFloatFn)(const float *src, void *dest, int numSamples);
+
+/* Rounding used when float samples are quantized for the driver. */
+enum class ASIORounding { nearest, truncate };
+
+//============================================================================
+class SampleConvert {
+public:
+	/* Returns the fastest 24-bit to float kernel for a given stride (3 = packed, 4 = Int32xSB24) and byte order.
+	 * All kernels produce exactly the same floats as int24ToFloatScalar.
+	 */
+	static ASIOConvertToFloatFn int24ToFloat(int byteStride, bool littleEndian) noexcept
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+		const bool packed = byteStride == 3;
+
+		if (cpu.avx2) {
+			if (packed)
+				return littleEndian ? int24ToFloatAVX2<3, true> : int24ToFloatAVX2<3, false>;
+			return littleEndian ? int24ToFloatAVX2<4, true> : int24ToFloatAVX2<4, false>;
+		}
+		if (cpu.ssse3) {
+			if (packed)
+				return littleEndian ? int24ToFloatSSSE3<3, true> : int24ToFloatSSSE3<3, false>;
+			return littleEndian ? int24ToFloatSSSE3<4, true> : int24ToFloatSSSE3<4, false>;
+		}
+		if (packed)
+			return littleEndian ? int24ToFloatSSE2<3, true> : int24ToFloatSSE2<3, false>;
+		return littleEndian ? int24ToFloatSSE2<4, true> : int24ToFloatSSE2<4, false>;
+	}
+
+	/* Returns the fastest Int16LSB/MSB to float kernel. */
+	static ASIOConvertToFloatFn int16ToFloat(bool littleEndian) noexcept
+	{
+		if (ASIOCpuFeatures::get().avx2)
+			return littleEndian ? int16ToFloatAVX2<true> : int16ToFloatAVX2<false>;
+		return littleEndian ? int16ToFloatSSE2<true> : int16ToFloatSSE2<false>;
+	}
+
+	/* Returns the fastest kernel for samples of the given bit depth held in 4-byte containers
+	 * (Int32LSB/MSB and Int32xSB16/18/20). Big-endian samples are byte-swapped with pshufb when available.
+	 */
+	template<int bits> static ASIOConvertToFloatFn int32ToFloat(bool littleEndian) noexcept
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+
+		if (bits == 24)
+			return int24ToFloat(4, littleEndian);
+		if (cpu.avx2)
+			return littleEndian ? int32ToFloatAVX2<bits, true> : int32ToFloatAVX2<bits, false>;
+		if (!littleEndian && cpu.ssse3)
+			return int32ToFloatSSSE3<bits>;
+		return littleEndian ? int32ToFloatSSE2<bits, true> : int32ToFloatSSE2<bits, false>;
+	}
+
+	/* Returns the fastest double to float narrowing kernel for Float64LSB/MSB. */
+	static ASIOConvertToFloatFn float64ToFloat(bool littleEndian) noexcept
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+
+		if (littleEndian)
+			return cpu.avx ? float64ToFloatAVX : float64ToFloatSSE2;
+		if (cpu.avx2)
+			return float64MSBToFloatAVX2;
+		if (cpu.ssse3)
+			return float64ToFloatSSSE3;
+		return float64ToFloatScalar<false>;
+	}
+
+	template<bool littleEndian>
+	static void float64ToFloatScalar(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+
+		while (--numSamples >= 0) {
+			uint64_t v;
+			memcpy(&v, src, sizeof(v));
+			if (!littleEndian)
+				v = ByteOrder::swap(v);
+			double d;
+			memcpy(&d, &v, sizeof(d));
+			*dest++ = (float)d;
+			src += 8;
+		}
+	}
+
+	template<bool littleEndian> static void floatToFloat64(const float *src, void *destination, int numSamples) noexcept
+	{
+		char *dest = static_cast<char *>(destination);
+
+		while (--numSamples >= 0) {
+			double d = *src++;
+			uint64_t v;
+			memcpy(&v, &d, sizeof(v));
+			if (!littleEndian)
+				v = ByteOrder::swap(v);
+			memcpy(dest, &v, sizeof(v));
+			dest += 8;
+		}
+	}
+
+	/* Reference implementation; also used for the tails of the simd kernels.
+	 * Big-endian containers hold the 24 significant bits in their last 3 bytes.
+	 */
+	template<int stride, bool littleEndian>
+	static void int24ToFloatScalar(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const float g = int24Scale;
+
+		while (--numSamples >= 0) {
+			*dest++ = g * (float)(littleEndian ? ByteOrder::littleEndian24Bit(src)
+							   : ByteOrder::bigEndian24Bit(src + stride - 3));
+			src += stride;
+		}
+	}
+
+	static constexpr float int24Scale = 1.0f / 0x7fffff;
+
+	/* Integer samples of a given bit depth stored in containers of 2, 3 or 4 bytes (Int32xSB16/18/20/24 keep
+	 * the sample in the least significant bits of the container).
+	 */
+	template<int bytes, int bits, bool littleEndian>
+	static void intToFloat(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+
+		while (--numSamples >= 0) {
+			int32_t v = readInt<bytes, littleEndian>(src);
+			if (bits < bytes * 8)
+				v = signExtend<bits>(v);
+			if (bits == 32)
+				*dest++ = (float)(1.0 / 0x7fffffff * v);
+			else
+				*dest++ = intScale<bits>() * (float)v;
+			src += bytes;
+		}
+	}
+
+	/* Returns the fastest float to integer kernel for a container. TPDF dither (+-1 lsb, triangular) is only
+	 * applied to 16 and 24-bit samples; below that depth it would sit under the noise floor of any converter.
+	 */
+	template<int bytes, int bits, bool littleEndian>
+	static ASIOConvertFromFloatFn floatToInt(ASIORounding rounding, bool dither) noexcept
+	{
+		if (dither && bits <= 24)
+			return rounding == ASIORounding::nearest
+				       ? floatToIntFor<bytes, bits, littleEndian, ASIORounding::nearest, true>()
+				       : floatToIntFor<bytes, bits, littleEndian, ASIORounding::truncate, true>();
+		return rounding == ASIORounding::nearest
+			       ? floatToIntFor<bytes, bits, littleEndian, ASIORounding::nearest, false>()
+			       : floatToIntFor<bytes, bits, littleEndian, ASIORounding::truncate, false>();
+	}
+
+	/* Reference implementation; also used for the tails of the simd kernels.
+	 * Samples are clamped to +-max (nan becomes +max) and rounded half to even like cvtps2dq does; 32-bit
+	 * samples are scaled in double since 2^31 - 1 has no float representation.
+	 */
+	template<int bytes, int bits, bool littleEndian, ASIORounding rounding = ASIORounding::nearest,
+		 bool dither = false>
+	static void floatToIntScalar(const float *src, void *destination, int numSamples) noexcept
+	{
+		char *dest = static_cast<char *>(destination);
+		const double maxVal = (double)((1u << (bits - 1)) - 1);
+		uint32_t *rng = ditherState();
+
+		while (--numSamples >= 0) {
+			double v;
+			if (bits <= 24) {
+				// the simd kernels scale in float
+				float f = (float)maxVal * *src++;
+				if (dither)
+					f += nextTriangular(rng[0]);
+				v = f;
+			} else {
+				v = maxVal * *src++;
+			}
+			v = v < maxVal ? v : maxVal;
+			v = v > -maxVal ? v : -maxVal;
+			const int32_t q = rounding == ASIORounding::nearest ? (int32_t)std::lrint(v) : (int32_t)v;
+			writeInt<bytes, littleEndian>(q, dest);
+			dest += bytes;
+		}
+	}
+
+	template<bool littleEndian> static void float32ToFloat(const void *src, float *dest, int numSamples) noexcept
+	{
+		if (littleEndian) {
+			memcpy(dest, src, numSamples * sizeof(float));
+			return;
+		}
+		const uint32_t *s = static_cast<const uint32_t *>(src);
+		while (--numSamples >= 0) {
+			uint32_t v = ByteOrder::swap(*s++);
+			memcpy(dest++, &v, sizeof(v));
+		}
+	}
+
+	template<bool littleEndian> static void floatToFloat32(const float *src, void *dest, int numSamples) noexcept
+	{
+		if (littleEndian) {
+			memcpy(dest, src, numSamples * sizeof(float));
+			return;
+		}
+		uint32_t *d = static_cast<uint32_t *>(dest);
+		while (--numSamples >= 0) {
+			uint32_t v;
+			memcpy(&v, src++, sizeof(v));
+			*d++ = ByteOrder::swap(v);
+		}
+	}
+
+	/* Formats we can't decode deliver silence rather than stale buffer contents. */
+	static void silenceToFloat(const void *, float *dest, int numSamples) noexcept
+	{
+		memset(dest, 0, numSamples * sizeof(float));
+	}
+
+	static void silenceFromFloat(const float *, void *, int) noexcept {}
+
+private:
+	SampleConvert() = delete;
+	// tests/test-convert.cpp checks every kernel against the scalar references
+	friend struct SampleConvertTest;
+
+	static inline int32_t load32(const char *p) noexcept
+	{
+		int32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	template<int bytes, bool littleEndian> static inline int32_t readInt(const char *p) noexcept
+	{
+		if (bytes == 2)
+			return (int16_t)(littleEndian ? ByteOrder::littleEndianShort(p) : ByteOrder::bigEndianShort(p));
+		if (bytes == 3)
+			return littleEndian ? ByteOrder::littleEndian24Bit(p) : ByteOrder::bigEndian24Bit(p);
+		return (int32_t)(littleEndian ? ByteOrder::littleEndianInt(p) : ByteOrder::bigEndianInt(p));
+	}
+
+	template<int bytes, bool littleEndian> static inline void writeInt(int32_t v, char *p) noexcept
+	{
+		if (bytes == 3) {
+			if (littleEndian)
+				ByteOrder::littleEndian24BitToChars(v, p);
+			else
+				ByteOrder::bigEndian24BitToChars(v, p);
+			return;
+		}
+		for (int b = 0; b < bytes; b++)
+			p[littleEndian ? b : bytes - 1 - b] = (char)(v >> (8 * b));
+	}
+
+	template<int bits> static inline int32_t signExtend(int32_t v) noexcept
+	{
+		return (int32_t)((uint32_t)v << (32 - bits)) >> (32 - bits);
+	}
+
+	/* 16-bit samples have always been scaled by a power of two, the others by their max positive value. */
+	template<int bits> static constexpr float intScale() noexcept
+	{
+		return bits == 16 ? 1.0f / 32768.0f : 1.0f / (float)((1u << (bits - 1)) - 1);
+	}
+
+	/* Reverses the bytes of each 32-bit lane with sse2 only. */
+	static inline __m128i bswap32SSE2(__m128i v) noexcept
+	{
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	}
+
+	/* pshufb masks which move the 3 sample bytes to the top of each 32-bit lane, most significant byte last.
+	 * Big-endian Int32MSB24 containers keep the sample in their last 3 bytes.
+	 */
+	template<int stride, bool littleEndian> static inline __m128i int24Mask() noexcept
+	{
+		constexpr char s = (char)stride;
+		if (littleEndian)
+			return _mm_setr_epi8(-128, 0, 1, 2, -128, s, s + 1, s + 2, -128, 2 * s, 2 * s + 1, 2 * s + 2,
+					     -128, 3 * s, 3 * s + 1, 3 * s + 2);
+		constexpr char o = (char)(stride - 3);
+		return _mm_setr_epi8(-128, o + 2, o + 1, o, -128, o + s + 2, o + s + 1, o + s, -128, o + 2 * s + 2,
+				     o + 2 * s + 1, o + 2 * s, -128, o + 3 * s + 2, o + 3 * s + 1, o + 3 * s);
+	}
+
+	static inline __m128i bswap64Mask() noexcept
+	{
+		return _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	}
+
+	ASIO_TARGET("sse2")
+	static void float64ToFloatSSE2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const double *src = static_cast<const double *>(source);
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4) {
+			__m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+			__m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+			_mm_storeu_ps(dest + i, _mm_movelh_ps(lo, hi));
+		}
+		float64ToFloatScalar<true>(src + i, dest + i, numSamples - i);
+	}
+
+	ASIO_TARGET("ssse3")
+	static void float64ToFloatSSSE3(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m128i mask = bswap64Mask();
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(src + i * 8));
+			__m128i b = _mm_loadu_si128((const __m128i *)(src + i * 8 + 16));
+			__m128 lo = _mm_cvtpd_ps(_mm_castsi128_pd(_mm_shuffle_epi8(a, mask)));
+			__m128 hi = _mm_cvtpd_ps(_mm_castsi128_pd(_mm_shuffle_epi8(b, mask)));
+			_mm_storeu_ps(dest + i, _mm_movelh_ps(lo, hi));
+		}
+		float64ToFloatScalar<false>(src + i * 8, dest + i, numSamples - i);
+	}
+
+	ASIO_TARGET("avx")
+	static void float64ToFloatAVX(const void *source, float *dest, int numSamples) noexcept
+	{
+		const double *src = static_cast<const double *>(source);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8) {
+			_mm_storeu_ps(dest + i, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i)));
+			_mm_storeu_ps(dest + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4)));
+		}
+		float64ToFloatScalar<true>(src + i, dest + i, numSamples - i);
+	}
+
+	/* The big-endian variant needs avx2 for the 256-bit byte shuffle. */
+	ASIO_TARGET("avx2")
+	static void float64MSBToFloatAVX2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(bswap64Mask()), bswap64Mask(), 1);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8) {
+			__m256i a = _mm256_loadu_si256((const __m256i *)(src + i * 8));
+			__m256i b = _mm256_loadu_si256((const __m256i *)(src + i * 8 + 32));
+			_mm_storeu_ps(dest + i, _mm256_cvtpd_ps(_mm256_castsi256_pd(_mm256_shuffle_epi8(a, mask))));
+			_mm_storeu_ps(dest + i + 4, _mm256_cvtpd_ps(_mm256_castsi256_pd(_mm256_shuffle_epi8(b, mask))));
+		}
+		float64ToFloatScalar<false>(src + i * 8, dest + i, numSamples - i);
+	}
+
+	static inline __m128i bswap32Mask() noexcept
+	{
+		return _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	}
+
+	template<bool littleEndian>
+	ASIO_TARGET("sse2")
+	static void int16ToFloatSSE2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m128 g = _mm_set1_ps(intScale<16>());
+		const __m128i zero = _mm_setzero_si128();
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+			if (!littleEndian)
+				v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			// put each sample in the upper half of a 32-bit lane, then sign-extend it down
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16);
+			_mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), g));
+			_mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), g));
+		}
+		intToFloat<2, 16, littleEndian>(src + i * 2, dest + i, numSamples - i);
+	}
+
+	template<bool littleEndian>
+	ASIO_TARGET("avx2")
+	static void int16ToFloatAVX2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m256 g = _mm256_set1_ps(intScale<16>());
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+			if (!littleEndian)
+				v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			__m256i w = _mm256_cvtepi16_epi32(v);
+			_mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(w), g));
+		}
+		intToFloat<2, 16, littleEndian>(src + i * 2, dest + i, numSamples - i);
+	}
+
+	/* Sign-extends the low bits of each lane and scales; 32-bit samples are scaled in double like the scalar
+	 * path so that every kernel returns the same floats.
+	 */
+	template<int bits> ASIO_TARGET("sse2") static inline __m128 scaleInt32SSE2(__m128i v) noexcept
+	{
+		if (bits == 32) {
+			const __m128d g = _mm_set1_pd(1.0 / 0x7fffffff);
+			__m128 lo = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtepi32_pd(v), g));
+			__m128 hi = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))), g));
+			return _mm_movelh_ps(lo, hi);
+		}
+		v = _mm_srai_epi32(_mm_slli_epi32(v, 32 - bits), 32 - bits);
+		return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(intScale<bits>()));
+	}
+
+	template<int bits, bool littleEndian>
+	ASIO_TARGET("sse2")
+	static void int32ToFloatSSE2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+			if (!littleEndian)
+				v = bswap32SSE2(v);
+			_mm_storeu_ps(dest + i, scaleInt32SSE2<bits>(v));
+		}
+		intToFloat<4, bits, littleEndian>(src + i * 4, dest + i, numSamples - i);
+	}
+
+	template<int bits>
+	ASIO_TARGET("ssse3")
+	static void int32ToFloatSSSE3(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m128i mask = bswap32Mask();
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+			_mm_storeu_ps(dest + i, scaleInt32SSE2<bits>(_mm_shuffle_epi8(v, mask)));
+		}
+		intToFloat<4, bits, false>(src + i * 4, dest + i, numSamples - i);
+	}
+
+	template<int bits, bool littleEndian>
+	ASIO_TARGET("avx2")
+	static void int32ToFloatAVX2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(bswap32Mask()), bswap32Mask(), 1);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+			if (!littleEndian)
+				v = _mm256_shuffle_epi8(v, mask);
+			if (bits == 32) {
+				const __m256d g = _mm256_set1_pd(1.0 / 0x7fffffff);
+				__m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+				__m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+				_mm_storeu_ps(dest + i, _mm256_cvtpd_ps(_mm256_mul_pd(lo, g)));
+				_mm_storeu_ps(dest + i + 4, _mm256_cvtpd_ps(_mm256_mul_pd(hi, g)));
+			} else {
+				v = _mm256_srai_epi32(_mm256_slli_epi32(v, 32 - bits), 32 - bits);
+				_mm256_storeu_ps(dest + i,
+						 _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(intScale<bits>())));
+			}
+		}
+		intToFloat<4, bits, littleEndian>(src + i * 4, dest + i, numSamples - i);
+	}
+
+	template<int bytes, int bits, bool littleEndian, ASIORounding rounding, bool dither>
+	static ASIOConvertFromFloatFn floatToIntFor() noexcept
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+
+		if (cpu.avx2)
+			return floatToIntAVX2<bytes, bits, littleEndian, rounding, dither>;
+		if (bytes == 3 && cpu.ssse3)
+			return floatToInt24SSSE3<littleEndian, rounding, dither>;
+		return floatToIntSSE2<bytes, bits, littleEndian, rounding, dither>;
+	}
+
+	/* xorshift32 state of the converting thread, one word per simd lane; lane 0 also feeds the scalar tails.
+	 * Accessed with unaligned loads and stores: the alignment of thread_local data is not guaranteed in a dll
+	 * loaded at run time, like an obs plugin.
+	 */
+	static uint32_t *ditherState() noexcept
+	{
+		alignas(32) static thread_local uint32_t state[8] = {0x9e3779b9, 0x7f4a7c15, 0x85ebca6b, 0xc2b2ae35,
+								     0x27d4eb2f, 0x165667b1, 0xd3a2646c, 0xfd7046c5};
+		return state;
+	}
+
+	/* One xorshift32 step; the difference of the two 16-bit halves gives a triangular value in (-1, 1). */
+	static inline float nextTriangular(uint32_t &x) noexcept
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return (float)((int32_t)(x >> 16) - (int32_t)(x & 0xffff)) * (1.0f / 65536.0f);
+	}
+
+	ASIO_TARGET("sse2") static inline __m128 nextTriangularSSE2(__m128i &x) noexcept
+	{
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+		__m128i d = _mm_sub_epi32(_mm_srli_epi32(x, 16), _mm_and_si128(x, _mm_set1_epi32(0xffff)));
+		return _mm_mul_ps(_mm_cvtepi32_ps(d), _mm_set1_ps(1.0f / 65536.0f));
+	}
+
+	ASIO_TARGET("avx2") static inline __m256 nextTriangularAVX2(__m256i &x) noexcept
+	{
+		x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+		x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+		__m256i d = _mm256_sub_epi32(_mm256_srli_epi32(x, 16), _mm256_and_si256(x, _mm256_set1_epi32(0xffff)));
+		return _mm256_mul_ps(_mm256_cvtepi32_ps(d), _mm256_set1_ps(1.0f / 65536.0f));
+	}
+
+	/* Scales, dithers, clamps and rounds 4 floats to integers; matches floatToIntScalar exactly. */
+	template<int bits, ASIORounding rounding, bool dither>
+	ASIO_TARGET("sse2")
+	static inline __m128i quantizeSSE2(__m128 x, __m128i &rng) noexcept
+	{
+		if (bits == 32) {
+			const __m128d g = _mm_set1_pd(2147483647.0);
+			__m128d lo = _mm_mul_pd(_mm_cvtps_pd(x), g);
+			__m128d hi = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), g);
+			lo = _mm_max_pd(_mm_min_pd(lo, g), _mm_sub_pd(_mm_setzero_pd(), g));
+			hi = _mm_max_pd(_mm_min_pd(hi, g), _mm_sub_pd(_mm_setzero_pd(), g));
+			if (rounding == ASIORounding::nearest)
+				return _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo), _mm_cvtpd_epi32(hi));
+			return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+		}
+		const __m128 g = _mm_set1_ps((float)((1u << (bits - 1)) - 1));
+		x = _mm_mul_ps(x, g);
+		if (dither)
+			x = _mm_add_ps(x, nextTriangularSSE2(rng));
+		x = _mm_max_ps(_mm_min_ps(x, g), _mm_sub_ps(_mm_setzero_ps(), g));
+		return rounding == ASIORounding::nearest ? _mm_cvtps_epi32(x) : _mm_cvttps_epi32(x);
+	}
+
+	template<int bits, ASIORounding rounding, bool dither>
+	ASIO_TARGET("avx2")
+	static inline __m256i quantizeAVX2(__m256 x, __m256i &rng) noexcept
+	{
+		if (bits == 32) {
+			const __m256d g = _mm256_set1_pd(2147483647.0);
+			__m256d lo = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), g);
+			__m256d hi = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), g);
+			lo = _mm256_max_pd(_mm256_min_pd(lo, g), _mm256_sub_pd(_mm256_setzero_pd(), g));
+			hi = _mm256_max_pd(_mm256_min_pd(hi, g), _mm256_sub_pd(_mm256_setzero_pd(), g));
+			if (rounding == ASIORounding::nearest)
+				return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvtpd_epi32(lo)),
+							       _mm256_cvtpd_epi32(hi), 1);
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lo)),
+						       _mm256_cvttpd_epi32(hi), 1);
+		}
+		const __m256 g = _mm256_set1_ps((float)((1u << (bits - 1)) - 1));
+		x = _mm256_mul_ps(x, g);
+		if (dither)
+			x = _mm256_add_ps(x, nextTriangularAVX2(rng));
+		x = _mm256_max_ps(_mm256_min_ps(x, g), _mm256_sub_ps(_mm256_setzero_ps(), g));
+		return rounding == ASIORounding::nearest ? _mm256_cvtps_epi32(x) : _mm256_cvttps_epi32(x);
+	}
+
+	/* pshufb mask which packs the low 3 bytes of each 32-bit lane into the first 12 bytes. */
+	template<bool littleEndian> static inline __m128i pack24Mask() noexcept
+	{
+		if (littleEndian)
+			return _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+		return _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -128, -128, -128, -128);
+	}
+
+	template<int bytes, int bits, bool littleEndian, ASIORounding rounding, bool dither>
+	ASIO_TARGET("sse2")
+	static void floatToIntSSE2(const float *src, void *destination, int numSamples) noexcept
+	{
+		char *dest = static_cast<char *>(destination);
+		uint32_t *state = ditherState();
+		__m128i rng = _mm_loadu_si128((const __m128i *)state);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8) {
+			__m128i a = quantizeSSE2<bits, rounding, dither>(_mm_loadu_ps(src + i), rng);
+			__m128i b = quantizeSSE2<bits, rounding, dither>(_mm_loadu_ps(src + i + 4), rng);
+			if (bytes == 2) {
+				__m128i v = _mm_packs_epi32(a, b);
+				if (!littleEndian)
+					v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+				_mm_storeu_si128((__m128i *)(dest + i * 2), v);
+			} else if (bytes == 4) {
+				if (!littleEndian) {
+					a = bswap32SSE2(a);
+					b = bswap32SSE2(b);
+				}
+				_mm_storeu_si128((__m128i *)(dest + i * 4), a);
+				_mm_storeu_si128((__m128i *)(dest + i * 4 + 16), b);
+			} else {
+				int32_t q[8];
+				_mm_storeu_si128((__m128i *)q, a);
+				_mm_storeu_si128((__m128i *)(q + 4), b);
+				for (int k = 0; k < 8; k++)
+					writeInt<3, littleEndian>(q[k], dest + (i + k) * 3);
+			}
+		}
+		_mm_storeu_si128((__m128i *)state, rng);
+		floatToIntScalar<bytes, bits, littleEndian, rounding, dither>(src + i, dest + i * bytes,
+									      numSamples - i);
+	}
+
+	/* Packed 24-bit output; each 16-byte store spills 4 bytes which the next one overwrites, hence the
+	 * 2 samples of slack in the loop bound.
+	 */
+	template<bool littleEndian, ASIORounding rounding, bool dither>
+	ASIO_TARGET("ssse3")
+	static void floatToInt24SSSE3(const float *src, void *destination, int numSamples) noexcept
+	{
+		char *dest = static_cast<char *>(destination);
+		const __m128i mask = pack24Mask<littleEndian>();
+		uint32_t *state = ditherState();
+		__m128i rng = _mm_loadu_si128((const __m128i *)state);
+		int i = 0;
+
+		for (; i + 6 <= numSamples; i += 4) {
+			__m128i v = quantizeSSE2<24, rounding, dither>(_mm_loadu_ps(src + i), rng);
+			_mm_storeu_si128((__m128i *)(dest + i * 3), _mm_shuffle_epi8(v, mask));
+		}
+		_mm_storeu_si128((__m128i *)state, rng);
+		floatToIntScalar<3, 24, littleEndian, rounding, dither>(src + i, dest + i * 3, numSamples - i);
+	}
+
+	template<int bytes, int bits, bool littleEndian, ASIORounding rounding, bool dither>
+	ASIO_TARGET("avx2")
+	static void floatToIntAVX2(const float *src, void *destination, int numSamples) noexcept
+	{
+		char *dest = static_cast<char *>(destination);
+		uint32_t *state = ditherState();
+		__m256i rng = _mm256_loadu_si256((const __m256i *)state);
+		const int slack = bytes == 3 ? 2 : 0;
+		int i = 0;
+
+		for (; i + 8 + slack <= numSamples; i += 8) {
+			__m256i v = quantizeAVX2<bits, rounding, dither>(_mm256_loadu_ps(src + i), rng);
+			__m128i lo = _mm256_castsi256_si128(v);
+			__m128i hi = _mm256_extracti128_si256(v, 1);
+			if (bytes == 2) {
+				__m128i w = _mm_packs_epi32(lo, hi);
+				if (!littleEndian)
+					w = _mm_or_si128(_mm_slli_epi16(w, 8), _mm_srli_epi16(w, 8));
+				_mm_storeu_si128((__m128i *)(dest + i * 2), w);
+			} else if (bytes == 3) {
+				const __m128i mask = pack24Mask<littleEndian>();
+				_mm_storeu_si128((__m128i *)(dest + i * 3), _mm_shuffle_epi8(lo, mask));
+				_mm_storeu_si128((__m128i *)(dest + i * 3 + 12), _mm_shuffle_epi8(hi, mask));
+			} else {
+				if (!littleEndian)
+					v = _mm256_shuffle_epi8(v, _mm256_inserti128_si256(
+									   _mm256_castsi128_si256(bswap32Mask()),
+									   bswap32Mask(), 1));
+				_mm256_storeu_si256((__m256i *)(dest + i * 4), v);
+			}
+		}
+		_mm256_storeu_si256((__m256i *)state, rng);
+		floatToIntScalar<bytes, bits, littleEndian, rounding, dither>(src + i, dest + i * bytes,
+									      numSamples - i);
+	}
+
+	template<int stride, bool littleEndian>
+	ASIO_TARGET("sse2")
+	static void int24ToFloatSSE2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m128 g = _mm_set1_ps(int24Scale);
+		int i = 0;
+
+		// packed samples are gathered with 4-byte reads, so keep one readable byte past the group
+		const int guard = stride == 3 ? 1 : 0;
+		for (; i + 4 + guard <= numSamples; i += 4) {
+			const char *p = src + i * stride;
+			__m128i v = stride == 4 ? _mm_loadu_si128((const __m128i *)p)
+						: _mm_setr_epi32(load32(p), load32(p + stride), load32(p + 2 * stride),
+								 load32(p + 3 * stride));
+			if (!littleEndian)
+				v = bswap32SSE2(v);
+			if (littleEndian || stride == 4)
+				v = _mm_slli_epi32(v, 8);
+			v = _mm_srai_epi32(v, 8);
+			_mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(v), g));
+		}
+		int24ToFloatScalar<stride, littleEndian>(src + i * stride, dest + i, numSamples - i);
+	}
+
+	template<int stride, bool littleEndian>
+	ASIO_TARGET("ssse3")
+	static void int24ToFloatSSSE3(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m128 g = _mm_set1_ps(int24Scale);
+		const __m128i mask = int24Mask<stride, littleEndian>();
+		int i = 0;
+
+		// each group loads 16 bytes: 12 of them are used when packed
+		const int needed = stride == 3 ? 6 : 4;
+		for (; i + needed <= numSamples; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i * stride));
+			v = _mm_srai_epi32(_mm_shuffle_epi8(v, mask), 8);
+			_mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(v), g));
+		}
+		int24ToFloatScalar<stride, littleEndian>(src + i * stride, dest + i, numSamples - i);
+	}
+
+	template<int stride, bool littleEndian>
+	ASIO_TARGET("avx2")
+	static void int24ToFloatAVX2(const void *source, float *dest, int numSamples) noexcept
+	{
+		const char *src = static_cast<const char *>(source);
+		const __m256 g = _mm256_set1_ps(int24Scale);
+		const __m128i mask128 = int24Mask<stride, littleEndian>();
+		const __m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(mask128), mask128, 1);
+		int i = 0;
+
+		// vpshufb works within 128-bit lanes, so each lane gets its own 4 samples
+		const int needed = stride == 3 ? 10 : 8;
+		for (; i + needed <= numSamples; i += 8) {
+			const char *p = src + i * stride;
+			__m128i lo = _mm_loadu_si128((const __m128i *)p);
+			__m128i hi = _mm_loadu_si128((const __m128i *)(p + 4 * stride));
+			__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+			v = _mm256_srai_epi32(_mm256_shuffle_epi8(v, mask), 8);
+			_mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), g));
+		}
+		int24ToFloatSSSE3<stride, littleEndian>(src + i * stride, dest + i, numSamples - i);
+	}
+};
+
+//============================================================================
+/* Memory layout of an ASIO sample type: container size, significant bits, byte order. */
+struct ASIOSampleLayout {
+	int bytes;
+	int bits;
+	bool littleEndian;
+	bool isFloat;
+	bool isDSD;
+	bool supported;
+};
+
+constexpr ASIOSampleLayout asioSampleLayout(long type) noexcept
+{
+	switch (type) {
+	case ASIOSTInt16MSB:
+		return {2, 16, false, false, false, true};
+	case ASIOSTInt24MSB:
+		return {3, 24, false, false, false, true};
+	case ASIOSTInt32MSB:
+		return {4, 32, false, false, false, true};
+	case ASIOSTFloat32MSB:
+		return {4, 32, false, true, false, true};
+	case ASIOSTFloat64MSB:
+		return {8, 64, false, true, false, true};
+	case ASIOSTInt32MSB16:
+		return {4, 16, false, false, false, true};
+	case ASIOSTInt32MSB18:
+		return {4, 18, false, false, false, true};
+	case ASIOSTInt32MSB20:
+		return {4, 20, false, false, false, true};
+	case ASIOSTInt32MSB24:
+		return {4, 24, false, false, false, true};
+	case ASIOSTInt16LSB:
+		return {2, 16, true, false, false, true};
+	case ASIOSTInt24LSB:
+		return {3, 24, true, false, false, true};
+	case ASIOSTInt32LSB:
+		return {4, 32, true, false, false, true};
+	case ASIOSTFloat32LSB:
+		return {4, 32, true, true, false, true};
+	case ASIOSTFloat64LSB:
+		return {8, 64, true, true, false, true};
+	case ASIOSTInt32LSB16:
+		return {4, 16, true, false, false, true};
+	case ASIOSTInt32LSB18:
+		return {4, 18, true, false, false, true};
+	case ASIOSTInt32LSB20:
+		return {4, 20, true, false, false, true};
+	case ASIOSTInt32LSB24:
+		return {4, 24, true, false, false, true};
+	// DSD: one bit per sample, 8 samples per byte or one sample per byte for NER8
+	case ASIOSTDSDInt8LSB1:
+		return {1, 1, true, false, true, true};
+	case ASIOSTDSDInt8MSB1:
+		return {1, 1, false, false, true, true};
+	case ASIOSTDSDInt8NER8:
+		return {1, 1, false, false, true, true};
+	default:
+		return {1, 8, true, false, false, false};
+	}
+}
+
+/* The converters of a channel are resolved once, when the device is opened, so that the callback only has to
+ * call through the stored function pointers.
+ */
+struct ASIOSampleFormat {
+	ASIOSampleFormat() noexcept {}
+
+	/* rounding and dither only apply to integer output formats */
+	ASIOSampleFormat(long type, ASIORounding rounding = ASIORounding::nearest, bool dither = false) noexcept
+		: rounding(rounding),
+		  dither(dither)
+	{
+		switch (type) {
+		case ASIOSTInt16MSB:
+			setType<ASIOSTInt16MSB>();
+			break;
+		case ASIOSTInt24MSB:
+			setType<ASIOSTInt24MSB>();
+			break;
+		case ASIOSTInt32MSB:
+			setType<ASIOSTInt32MSB>();
+			break;
+		case ASIOSTFloat32MSB:
+			setType<ASIOSTFloat32MSB>();
+			break;
+		case ASIOSTFloat64MSB:
+			setType<ASIOSTFloat64MSB>();
+			break;
+		case ASIOSTInt32MSB16:
+			setType<ASIOSTInt32MSB16>();
+			break;
+		case ASIOSTInt32MSB18:
+			setType<ASIOSTInt32MSB18>();
+			break;
+		case ASIOSTInt32MSB20:
+			setType<ASIOSTInt32MSB20>();
+			break;
+		case ASIOSTInt32MSB24:
+			setType<ASIOSTInt32MSB24>();
+			break;
+		case ASIOSTInt16LSB:
+			setType<ASIOSTInt16LSB>();
+			break;
+		case ASIOSTInt24LSB:
+			setType<ASIOSTInt24LSB>();
+			break;
+		case ASIOSTInt32LSB:
+			setType<ASIOSTInt32LSB>();
+			break;
+		case ASIOSTFloat32LSB:
+			setType<ASIOSTFloat32LSB>();
+			break;
+		case ASIOSTFloat64LSB:
+			setType<ASIOSTFloat64LSB>();
+			break;
+		case ASIOSTInt32LSB16:
+			setType<ASIOSTInt32LSB16>();
+			break;
+		case ASIOSTInt32LSB18:
+			setType<ASIOSTInt32LSB18>();
+			break;
+		case ASIOSTInt32LSB20:
+			setType<ASIOSTInt32LSB20>();
+			break;
+		case ASIOSTInt32LSB24:
+			setType<ASIOSTInt32LSB24>();
+			break;
+
+		// DSD is decimated by the device (see DSDDecimator), toFloat is never called for it
+		case ASIOSTDSDInt8LSB1:
+			setType<ASIOSTDSDInt8LSB1>();
+			break;
+		case ASIOSTDSDInt8MSB1:
+			setType<ASIOSTDSDInt8MSB1>();
+			break;
+		case ASIOSTDSDInt8NER8:
+			setType<ASIOSTDSDInt8NER8>();
+			packedDSD = false;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	void convertToFloat(const void *src, float *dst, int samps) const noexcept { toFloat(src, dst, samps); }
+
+	void convertFromFloat(const float *src, void *dst, int samps) const noexcept { fromFloat(src, dst, samps); }
+
+	int bitDepth = 24, byteStride = 4;
+	bool formatIsFloat = false, littleEndian = true, supported = false;
+	bool isDSD = false, packedDSD = true;
+	/* native Float32LSB samples are what obs takes: a source may read them straight from the driver buffers */
+	bool passThrough = false;
+	ASIORounding rounding = ASIORounding::nearest;
+	bool dither = false;
+	ASIOConvertToFloatFn toFloat = SampleConvert::silenceToFloat;
+	ASIOConvertFromFloatFn fromFloat = SampleConvert::silenceFromFloat;
+
+private:
+	template<long type> void setType() noexcept
+	{
+		constexpr ASIOSampleLayout layout = asioSampleLayout(type);
+		bitDepth = layout.bits;
+		byteStride = layout.bytes;
+		littleEndian = layout.littleEndian;
+		formatIsFloat = layout.isFloat;
+		isDSD = layout.isDSD;
+		supported = layout.supported;
+		if (!layout.supported || layout.isDSD)
+			return;
+
+		if constexpr (layout.isFloat && layout.bytes == 8) {
+			toFloat = SampleConvert::float64ToFloat(layout.littleEndian);
+			fromFloat = SampleConvert::floatToFloat64<layout.littleEndian>;
+		} else if constexpr (layout.isFloat) {
+			toFloat = SampleConvert::float32ToFloat<layout.littleEndian>;
+			fromFloat = SampleConvert::floatToFloat32<layout.littleEndian>;
+			passThrough = layout.littleEndian;
+		} else {
+			fromFloat = SampleConvert::floatToInt<layout.bytes, layout.bits, layout.littleEndian>(rounding,
+												      dither);
+			if (layout.bytes == 2)
+				toFloat = SampleConvert::int16ToFloat(layout.littleEndian);
+			else if (layout.bytes == 3)
+				toFloat = SampleConvert::int24ToFloat(3, layout.littleEndian);
+			else
+				toFloat = SampleConvert::int32ToFloat<layout.bits>(layout.littleEndian);
+		}
+	}
+};
@@ -0,0 +1,180 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * DSD to PCM decimation for ASIO drivers running in DSD mode.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+//============================================================================
+/* Low-pass FIR used to decimate a 1-bit DSD stream, stored as byte-indexed lookup tables.
+ * Each group of 8 consecutive taps gets a 256 entry table holding the filter output for every possible byte
+ * (bit set = +1, bit clear = -1), so one output sample costs one lookup per byte of filter history instead of
+ * one multiply-add per bit.
+ */
+class DSDDecimationFilter {
+public:
+	/* decimation is in DSD samples (bits) per PCM sample and must be a multiple of 8. */
+	DSDDecimationFilter(int decimation, bool lsbFirst) : decimation(decimation), numTables(2 * decimation)
+	{
+		const int numTaps = numTables * 8;
+		std::vector<double> taps(numTaps);
+		designLowPass(taps, 0.27 / decimation);
+
+		tables.resize((size_t)numTables * 256);
+		for (int t = 0; t < numTables; t++) {
+			for (int byte = 0; byte < 256; byte++) {
+				double acc = 0.0;
+				for (int bit = 0; bit < 8; bit++) {
+					// table 0 holds the newest byte; within a byte the latest bit is bit 0 when the
+					// stream is msb first and bit 7 when it is lsb first
+					const int age = lsbFirst ? 7 - bit : bit;
+					const double x = (byte >> bit) & 1 ? 1.0 : -1.0;
+					acc += taps[t * 8 + age] * x;
+				}
+				tables[(size_t)t * 256 + byte] = (float)acc;
+			}
+		}
+	}
+
+	/* Picks the power of two decimation which brings a DSD rate down to a PCM rate of at most 96 kHz,
+	 * i.e. 88.2 kHz for DSD64/128/256 and 96 kHz for their 48 kHz based variants.
+	 */
+	static int decimationForRate(double dsdRate) noexcept
+	{
+		int d = 8;
+		while (dsdRate / d > 96000.0)
+			d *= 2;
+		return d;
+	}
+
+	const float *table(int index) const noexcept { return &tables[(size_t)index * 256]; }
+
+	const int decimation;
+	const int numTables;
+
+private:
+	std::vector<float> tables;
+
+	/* Blackman windowed sinc with unity gain at DC; cutoff is in cycles per DSD sample. */
+	static void designLowPass(std::vector<double> &taps, double cutoff)
+	{
+		const double pi = 3.14159265358979323846;
+		const int n = (int)taps.size();
+		const double center = (n - 1) / 2.0;
+		double sum = 0.0;
+
+		for (int i = 0; i < n; i++) {
+			const double x = i - center;
+			const double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * x) / (pi * x);
+			const double w = 0.42 - 0.5 * std::cos(2.0 * pi * i / (n - 1)) +
+					 0.08 * std::cos(4.0 * pi * i / (n - 1));
+			taps[i] = sinc * w;
+			sum += taps[i];
+		}
+		for (double &t : taps)
+			t /= sum;
+	}
+};
+
+//============================================================================
+/* Per-channel decimation state; runs on the driver thread. */
+class DSDDecimator {
+public:
+	DSDDecimator(std::shared_ptr<const DSDDecimationFilter> f, bool onebitPerByte)
+		: filter(std::move(f)),
+		  bytesPerOutput(filter->decimation / 8),
+		  unpacked(onebitPerByte),
+		  history(2 * (size_t)filter->numTables, 0x69) // 0x69 = 01101001, digital silence pattern
+	{
+	}
+
+	/* Consumes numBytes bytes of DSD for one channel and writes the PCM samples completed by them.
+	 * Returns the number of PCM samples written to dest.
+	 */
+	int process(const void *source, int numBytes, float *dest) noexcept
+	{
+		const uint8_t *src = static_cast<const uint8_t *>(source);
+		int written = 0;
+
+		for (int i = 0; i < numBytes; i++) {
+			uint8_t b = src[i];
+			if (unpacked) {
+				// NER8 carries one bit per byte: pack them msb first
+				packed = (uint8_t)((packed << 1) | (b & 1));
+				if (++packedBits < 8)
+					continue;
+				packedBits = 0;
+				b = packed;
+			}
+			push(b);
+			if (++phase == bytesPerOutput) {
+				phase = 0;
+				dest[written++] = compute();
+			}
+		}
+		return written;
+	}
+
+	/* Advances the output phase of a channel nobody listens to, without filtering. */
+	void skip(int numBytes) noexcept
+	{
+		if (unpacked) {
+			numBytes += packedBits;
+			packedBits = numBytes % 8;
+			numBytes /= 8;
+		}
+		phase = (phase + numBytes) % bytesPerOutput;
+	}
+
+private:
+	std::shared_ptr<const DSDDecimationFilter> filter;
+	const int bytesPerOutput;
+	const bool unpacked;
+	std::vector<uint8_t> history; // mirrored ring so the newest numTables bytes are always contiguous
+	int writePos = 0;
+	int phase = 0;
+	uint8_t packed = 0;
+	int packedBits = 0;
+
+	inline void push(uint8_t b) noexcept
+	{
+		const int n = filter->numTables;
+		writePos = writePos == 0 ? n - 1 : writePos - 1;
+		history[writePos] = history[writePos + n] = b;
+	}
+
+	inline float compute() const noexcept
+	{
+		const int n = filter->numTables;
+		const uint8_t *h = &history[writePos]; // h[0] is the newest byte
+		float acc0 = 0.0f, acc1 = 0.0f;
+		int t = 0;
+		for (; t + 2 <= n; t += 2) {
+			acc0 += filter->table(t)[h[t]];
+			acc1 += filter->table(t + 1)[h[t + 1]];
+		}
+		for (; t < n; t++)
+			acc0 += filter->table(t)[h[t]];
+		return acc0 + acc1;
+	}
+};
@@ -25,7 +25,29 @@
 #include <util/platform.h>
 #include "asio-wrapper.hpp"
 #include "byteorder.h"
+#include "asio-arena.hpp"
+#include "asio-caps.hpp"
+#include "asio-convert.hpp"
+#include "asio-dsd.hpp"
+#include "asio-ring.hpp"
+#include "asio-timing.hpp"
+#include "asio-stats.hpp"
+#include "asio-meter.hpp"
+#include "asio-mix.hpp"
+#include "asio-packet.hpp"
+#include "asio-registry.hpp"
+#include "asio-resample.hpp"
+#include "asio-worker.hpp"
 #include <util/threading.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 #define ASIOCALLBACK __cdecl
 #define ASIO_LOG(level, format, ...) blog(level, "[asio source]: " format, ##__VA_ARGS__)
@@ -43,9 +65,9 @@ static ASIOAudioIODevice *currentASIODev[maxNumASIODevices] = {};
 struct asio_data {
 	obs_source_t *source;
 	ASIOAudioIODevice *asio_device;           // device class
-	int asio_client_index[maxNumASIODevices]; // index of obs source in device client list
+	bool device_client[maxNumASIODevices];    // whether the source is a client of each device
 	const char *device;                       // device name
-	uint8_t device_index;                     // device index in the driver list
+	uint8_t device_index;                     // slot of the device in currentASIODev
 	enum speaker_layout speakers;             // speaker layout
 	int sample_rate;                          // 44100 or 48000 Hz
 	std::atomic<bool> stopping;               // signals the source is stopping
@@ -53,266 +75,59 @@ struct asio_data {
 	uint8_t out_channels;                     // total number of output channels
 	int route[MAX_AUDIO_CHANNELS];            // stores the channel re-ordering info
 	std::atomic<bool> active;                 // tracks whether the device is streaming
+	std::atomic<uint64_t> frames_delivered;   // frames passed to obs
+	std::atomic<uint64_t> frames_dropped;     // frames lost because obs could not keep up
+	ASIOMixMatrix *mix;                       // optional mix matrix, replaced as a whole on update
+	ASIOMixMatrix *fading_mix;                // matrix replaced by the last update, its inputs fade out
+	ASIOMixer *mixer;                         // mixing state, used by the delivery thread only
+	bool device_resample;                     // lets the device resample to the obs rate for all its sources
+	int packet_ms;                            // duration of the packets sent to obs, 0 for the driver periods
+	bool direct_delivery;                     // lets the device pass native float driver buffers to obs as they are
+	uint64_t device_list_generation;          // driver list generation shown in the properties
 };
 
-int get_obs_output_channels()
-{
-	struct obs_audio_info aoi;
-	obs_get_audio_info(&aoi);
-	return (int)get_audio_channels(aoi.speakers);
-}
-
-//============================================================================
-struct ASIOSampleFormat {
-	ASIOSampleFormat() noexcept {}
-
-	ASIOSampleFormat(long type) noexcept
-	{
-		switch (type) {
-		case ASIOSTInt16MSB:
-			byteStride = 2;
-			littleEndian = false;
-			bitDepth = 16;
-			break;
-		case ASIOSTInt24MSB:
-			byteStride = 3;
-			littleEndian = false;
-			break;
-		case ASIOSTInt32MSB:
-			bitDepth = 32;
-			littleEndian = false;
-			break;
-		case ASIOSTFloat32MSB:
-			bitDepth = 32;
-			littleEndian = false;
-			formatIsFloat = true;
-			break;
-		case ASIOSTFloat64MSB:
-			bitDepth = 64;
-			byteStride = 8;
-			littleEndian = false;
-			break;
-		case ASIOSTInt32MSB16:
-			bitDepth = 16;
-			littleEndian = false;
-			break;
-		case ASIOSTInt32MSB18:
-			littleEndian = false;
-			break;
-		case ASIOSTInt32MSB20:
-			littleEndian = false;
-			break;
-		case ASIOSTInt32MSB24:
-			littleEndian = false;
-			break;
-		case ASIOSTInt16LSB:
-			byteStride = 2;
-			bitDepth = 16;
-			break;
-		case ASIOSTInt24LSB:
-			byteStride = 3;
-			break;
-		case ASIOSTInt32LSB:
-			bitDepth = 32;
-			break;
-		case ASIOSTFloat32LSB:
-			bitDepth = 32;
-			formatIsFloat = true;
-			break;
-		case ASIOSTFloat64LSB:
-			bitDepth = 64;
-			byteStride = 8;
-			break;
-		case ASIOSTInt32LSB16:
-			bitDepth = 16;
-			break;
-		case ASIOSTInt32LSB18:
-			break; // (unhandled)
-		case ASIOSTInt32LSB20:
-			break; // (unhandled)
-		case ASIOSTInt32LSB24:
-			break;
-
-		case ASIOSTDSDInt8LSB1:
-			break; // (unhandled)
-		case ASIOSTDSDInt8MSB1:
-			break; // (unhandled)
-		case ASIOSTDSDInt8NER8:
-			break; // (unhandled)
-
-		default:
-			break;
-		}
-	}
-
-	void convertToFloat(const void *src, float *dst, int samps) const noexcept
-	{
-		if (formatIsFloat) {
-			memcpy(dst, src, samps * sizeof(float));
-		} else {
-			switch (bitDepth) {
-			case 16:
-				convertInt16ToFloat(static_cast<const char *>(src), dst, byteStride, samps,
-						    littleEndian);
-				break;
-			case 24:
-				convertInt24ToFloat(static_cast<const char *>(src), dst, byteStride, samps,
-						    littleEndian);
-				break;
-			case 32:
-				convertInt32ToFloat(static_cast<const char *>(src), dst, byteStride, samps,
-						    littleEndian);
-				break;
-			default:
-				break;
-			}
-		}
-	}
-
-	void convertFromFloat(const float *src, void *dst, int samps) const noexcept
-	{
-		if (formatIsFloat) {
-			memcpy(dst, src, samps * sizeof(float));
-		} else {
-			switch (bitDepth) {
-			case 16:
-				convertFloatToInt16(src, static_cast<char *>(dst), byteStride, samps, littleEndian);
-				break;
-			case 24:
-				convertFloatToInt24(src, static_cast<char *>(dst), byteStride, samps, littleEndian);
-				break;
-			case 32:
-				convertFloatToInt32(src, static_cast<char *>(dst), byteStride, samps, littleEndian);
-				break;
-			default:
-				break;
-			}
-		}
-	}
-	//void clear(void *dst, int numSamps) noexcept
-	//{
-	//	if (dst != nullptr)
-	//		dst = calloc(numSamps * byteStride, sizeof(float));
-	//}
-
-	int bitDepth = 24, byteStride = 4;
-	bool formatIsFloat = false, littleEndian = true;
-
-private:
-	static void convertInt16ToFloat(const char *src, float *dest, int srcStrideBytes, int numSamples,
-					bool littleEndian) noexcept
-	{
-		const double g = 1.0 / 32768.0;
-
-		if (littleEndian) {
-			while (--numSamples >= 0) {
-				*dest++ = (float)(g * (short)ByteOrder::littleEndianShort(src));
-				src += srcStrideBytes;
-			}
-		} else {
-			while (--numSamples >= 0) {
-				*dest++ = (float)(g * (short)ByteOrder::bigEndianShort(src));
-				src += srcStrideBytes;
-			}
-		}
-	}
-
-	static void convertFloatToInt16(const float *src, char *dest, int dstStrideBytes, int numSamples,
-					bool littleEndian) noexcept
-	{
-		const double maxVal = (double)0x7fff;
-
-		if (littleEndian) {
-			while (--numSamples >= 0) {
-				*(uint16_t *)dest = ByteOrder::swapIfBigEndian(
-					(uint16_t)(short)std::lround(max(-maxVal, min(maxVal, maxVal * *src++))));
-				dest += dstStrideBytes;
-			}
-		} else {
-			while (--numSamples >= 0) {
-				*(uint16_t *)dest = ByteOrder::swapIfLittleEndian(
-					(uint16_t)(short)std::lround(max(-maxVal, min(maxVal, maxVal * *src++))));
-				dest += dstStrideBytes;
-			}
-		}
-	}
-
-	static void convertInt24ToFloat(const char *src, float *dest, int srcStrideBytes, int numSamples,
-					bool littleEndian) noexcept
-	{
-		const double g = 1.0 / 0x7fffff;
-
-		if (littleEndian) {
-			while (--numSamples >= 0) {
-				*dest++ = (float)(g * ByteOrder::littleEndian24Bit(src));
-				src += srcStrideBytes;
-			}
-		} else {
-			while (--numSamples >= 0) {
-				*dest++ = (float)(g * ByteOrder::bigEndian24Bit(src));
-				src += srcStrideBytes;
-			}
-		}
-	}
-
-	static void convertFloatToInt24(const float *src, char *dest, int dstStrideBytes, int numSamples,
-					bool littleEndian) noexcept
-	{
-		const double maxVal = (double)0x7fffff;
+/* What the delivery thread needs to feed one client, frozen when the client table is rebuilt. */
+struct ASIOClientEntry {
+	struct asio_data *data;
+	struct obs_source_audio packet; // layout, format & rate prefilled; delivery only sets data & timing
+	int route[MAX_AUDIO_CHANNELS];
+	int channels;
+	const ASIOMixMatrix *mix; // outputs it flags are mixed instead of routed
+};
 
-		if (littleEndian) {
-			while (--numSamples >= 0) {
-				ByteOrder::littleEndian24BitToChars(
-					(uint32_t)std::lround(max(-maxVal, min(maxVal, maxVal * *src++))), dest);
-				dest += dstStrideBytes;
-			}
-		} else {
-			while (--numSamples >= 0) {
-				ByteOrder::bigEndian24BitToChars(
-					(uint32_t)std::lround(max(-maxVal, min(maxVal, maxVal * *src++))), dest);
-				dest += dstStrideBytes;
-			}
-		}
-	}
+/* Immutable and dense: a new table is published on every client change and the old one retired. */
+struct ASIOClientTable {
+	std::vector<ASIOClientEntry> clients;
+	ASIOChannelMask inputs; // input channels read by at least one client
+	bool resample = false;  // clients get audio at the obs rate, resampled once per channel by the device
+	int packetMs = 0;      // shortest packet duration asked by the clients
+	bool direct = false;   // clients get the driver buffers on the driver thread, see deliverDirect()
+};
 
-	static void convertInt32ToFloat(const char *src, float *dest, int srcStrideBytes, int numSamples,
-					bool littleEndian) noexcept
-	{
-		const double g = 1.0 / 0x7fffffff;
+/* Number of obs output channels and obs sample rate, captured at load and refreshed on profile changes and source
+ * updates so that the audio callback never queries libobs for them.
+ */
+static std::atomic<int> obs_output_channels = 0;
+static std::atomic<int> obs_sample_rate = 0;
 
-		if (littleEndian) {
-			while (--numSamples >= 0) {
-				*dest++ = (float)(g * (int)ByteOrder::littleEndianInt(src));
-				src += srcStrideBytes;
-			}
-		} else {
-			while (--numSamples >= 0) {
-				*dest++ = (float)(g * (int)ByteOrder::bigEndianInt(src));
-				src += srcStrideBytes;
-			}
-		}
+static void refresh_obs_audio_info()
+{
+	struct obs_audio_info aoi;
+	if (obs_get_audio_info(&aoi)) {
+		obs_output_channels = (int)get_audio_channels(aoi.speakers);
+		obs_sample_rate = (int)aoi.samples_per_sec;
 	}
+}
 
-	static void convertFloatToInt32(const float *src, char *dest, int dstStrideBytes, int numSamples,
-					bool littleEndian) noexcept
-	{
-		const double maxVal = (double)0x7fffffff;
+int get_obs_output_channels()
+{
+	return obs_output_channels;
+}
 
-		if (littleEndian) {
-			while (--numSamples >= 0) {
-				*(uint32_t *)dest = ByteOrder::swapIfBigEndian(
-					(uint32_t)std::lround(max(-maxVal, min(maxVal, maxVal * *src++))));
-				dest += dstStrideBytes;
-			}
-		} else {
-			while (--numSamples >= 0) {
-				*(uint32_t *)dest = ByteOrder::swapIfLittleEndian(
-					(uint32_t)std::lround(max(-maxVal, min(maxVal, maxVal * *src++))));
-				dest += dstStrideBytes;
-			}
-		}
-	}
-};
+int get_obs_sample_rate()
+{
+	return obs_sample_rate;
+}
 
 /* log asio sdk errors */
 static void asioErrorLog(String context, long error)
@@ -350,6 +165,12 @@ static void asioErrorLog(String context, long error)
 	error("error %s - %s", context.c_str(), err);
 }
 
+/* ASIOSamples and ASIOTimeStamp are 64-bit values split in two 32-bit halves */
+static inline int64_t asio64bit(unsigned long hi, unsigned long lo)
+{
+	return (int64_t)(((uint64_t)hi << 32) | (uint32_t)lo);
+}
+
 os_sem_t *shutting_down;
 std::atomic<bool> shutting_down_atomic = false;
 
@@ -357,49 +178,147 @@ static void OBSEvent(enum obs_frontend_event event, void *)
 {
 	if (event == OBS_FRONTEND_EVENT_EXIT || event == OBS_FRONTEND_EVENT_SCRIPTING_SHUTDOWN) {
 		shutting_down_atomic = true;
+	} else if (event == OBS_FRONTEND_EVENT_PROFILE_CHANGED) {
+		refresh_obs_audio_info();
 	}
 }
 
-class ASIOAudioIODevice {
+/* The capability cache file, driver-caps.txt in the plugin config directory. */
+class ASIOConfigCapsFile : public ASIOCapsFile {
 public:
-	/* Each device will stream audio to a number of obs asio sources acting as audio clients. The clients are listed in
-	 * this public vector which stores the asio_data struct ptr.
-	 */
-	std::vector<struct asio_data *> obs_clients;
-	int current_nb_clients;
+	bool read(std::string &text) override
+	{
+		char *path = obs_module_config_path("driver-caps.txt");
+		char *content = path ? os_quick_read_utf8_file(path) : nullptr;
+		bfree(path);
+		if (!content)
+			return false;
+		text = content;
+		bfree(content);
+		return true;
+	}
 
+	bool write(const std::string &text) override
+	{
+		char *dir = obs_module_config_path("");
+		if (dir) {
+			os_mkdirs(dir);
+			bfree(dir);
+		}
+		char *path = obs_module_config_path("driver-caps.txt");
+		const bool ok = path &&
+				os_quick_write_utf8_file_safe(path, text.c_str(), text.size(), false, "tmp", "bak");
+		if (!ok)
+			warn("could not save the driver capabilities to %s", path ? path : "the config directory");
+		bfree(path);
+		return ok;
+	}
+};
+
+static ASIOCapsCache &capsCache()
+{
+	static ASIOCapsCache cache(std::make_unique<ASIOConfigCapsFile>());
+	return cache;
+}
+
+static String clsidString(const CLSID &clsid)
+{
+	char buf[48];
+	snprintf(buf, sizeof(buf), "{%08lX-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}", (unsigned long)clsid.Data1,
+		 clsid.Data2, clsid.Data3, clsid.Data4[0], clsid.Data4[1], clsid.Data4[2], clsid.Data4[3],
+		 clsid.Data4[4], clsid.Data4[5], clsid.Data4[6], clsid.Data4[7]);
+	return buf;
+}
+
+class ASIOAudioIODevice : private ASIOWorkerDriver {
 public:
-	ASIOAudioIODevice(const std::string &devName, CLSID clsID, int slotNumber) : classId(clsID)
+	/* Each device will stream audio to a number of obs asio sources acting as audio clients. The UI thread adds and
+	 * removes them; the delivery thread reads the published client table without locking.
+	 */
+	void addClient(struct asio_data *client)
+	{
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		std::vector<struct asio_data *> list = clientList();
+		if (std::find(list.begin(), list.end(), client) == list.end())
+			list.push_back(client);
+		publishClients(list);
+	}
+
+	/* Once this returns the delivery thread no longer references the client, which may then be freed. */
+	void removeClient(struct asio_data *client)
 	{
-		if (!bComInitialized)
-			bComInitialized = SUCCEEDED(CoInitialize(nullptr));
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		std::vector<struct asio_data *> list = clientList();
+		list.erase(std::remove(list.begin(), list.end(), client), list.end());
+		publishClients(list);
+	}
+
+	int getNumClients() const { return numClients; }
 
+	/* Rebuilds the client table and the set of input channels routed by at least one client (the callback only
+	 * converts these). Must be called whenever a client changes its routing or layout, and when the device is
+	 * reopened; attaching and detaching do it already.
+	 */
+	void updateClients()
+	{
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		publishClients(clientList());
+	}
+
+	/* Same, for a client changing its settings: apply() writes them under the lock serializing the table writers,
+	 * so that a table built concurrently (attach, reopen) never reads them half written.
+	 */
+	void updateClient(const std::function<void()> &apply)
+	{
+		std::lock_guard<std::mutex> lock(clientsMutex);
+		apply();
+		publishClients(clientList());
+	}
+
+public:
+	/* The driver is loaded and probed on the worker thread of the device, which owns it from then on. */
+	ASIOAudioIODevice(const std::string &devName, CLSID clsID, int slotNumber) : classId(clsID), slot(slotNumber)
+	{
 		deviceName = devName;
 		assert(currentASIODev[slotNumber] == nullptr);
 		currentASIODev[slotNumber] = this;
 
-		openDevice();
-		current_nb_clients = 0;
+		worker.start();
+		worker.post([this]() { openDevice(); });
 	}
 
 	~ASIOAudioIODevice()
 	{
-		free(inputFormat);
-		free(outputFormat);
-		free(ioBufferSpace);
-		free(bufferInfos);
-		if (bComInitialized) {
-			CoUninitialize();
-		}
 		for (int i = 0; i < maxNumASIODevices; ++i)
 			if (currentASIODev[i] == this)
 				currentASIODev[i] = nullptr;
 
-		close();
+		// the worker closes and releases the driver on its way out
+		worker.stop();
 		debug(" driver deleted.");
+		// the driver is gone, its buffer descriptions can go too
+		arena.release();
+	}
 
-		if (!removeCurrentDriver())
-			info("** Driver crashed while being closed");
+	/* Opens the device on its worker thread and returns at once. The future holds the error, empty on success;
+	 * done, if set, is called with it on the worker thread. Clients get audio from the first callback on.
+	 * Opening an already running or opening device returns the pending result. sr and bufferSizeSamples may be 0
+	 * for the current rate of the driver and its preferred buffer size, read on the worker.
+	 */
+	std::shared_future<String> openAsync(double sr, int bufferSizeSamples,
+					     std::function<void(const String &)> done = nullptr)
+	{
+		return worker.openAsync(sr, bufferSizeSamples, std::move(done));
+	}
+
+	/* Closes the device on its worker thread, unless a source attached again before the close ran. */
+	std::future<void> closeAsync() { return worker.closeAsync(); }
+
+	/* running once the first callback arrived */
+	ASIODeviceState getState() const
+	{
+		const ASIODeviceState s = worker.getState();
+		return s == ASIODeviceState::opening && calledback ? ASIODeviceState::running : s;
 	}
 
 	void updateSampleRates()
@@ -422,7 +341,10 @@ public:
 		}
 
 		if (sampleRates != newRates) {
-			sampleRates.swap(newRates);
+			{
+				std::lock_guard<std::mutex> lock(infoMutex);
+				sampleRates.swap(newRates);
+			}
 			String samplelist;
 			for (double r : sampleRates)
 				samplelist = samplelist.append(std::to_string(r)).append(", ");
@@ -431,15 +353,40 @@ public:
 	}
 
 	String getName() { return deviceName; }
+	/* index of the device in currentASIODev */
+	int getSlot() const { return slot; }
 
-	std::vector<String> getOutputChannelNames() { return outputChannelNames; }
-	std::vector<String> getInputChannelNames() { return inputChannelNames; }
+	/* the device description is written by the worker thread; these return copies */
+	std::vector<String> getOutputChannelNames()
+	{
+		std::lock_guard<std::mutex> lock(infoMutex);
+		return outputChannelNames;
+	}
+	std::vector<String> getInputChannelNames()
+	{
+		std::lock_guard<std::mutex> lock(infoMutex);
+		return inputChannelNames;
+	}
 
-	std::vector<double> getAvailableSampleRates() { return sampleRates; }
-	std::vector<int> getAvailableBufferSizes() { return bufferSizes; }
+	std::vector<double> getAvailableSampleRates()
+	{
+		std::lock_guard<std::mutex> lock(infoMutex);
+		return sampleRates;
+	}
+	std::vector<int> getAvailableBufferSizes()
+	{
+		std::lock_guard<std::mutex> lock(infoMutex);
+		return bufferSizes;
+	}
 	int getDefaultBufferSize() { return preferredBufferSize; }
 
-	int getXRunCount() const noexcept { return xruns; }
+	int getXRunCount() const noexcept { return reportsOverload ? (int)stats.xruns.load() : -1; }
+
+	/* one line summary of the callback timing since the device was opened */
+	String getStats() const { return stats.summary(); }
+
+	/* peak and rms of the converted inputs since the previous call */
+	String getLevels() { return meter.summary(); }
 
 	String open(double sr, int bufferSizeSamples)
 	{
@@ -461,15 +408,13 @@ public:
 
 		auto err = asioObject->getChannels(&totalNumInputChans, &totalNumOutputChans);
 		assert(err == ASE_OK);
-		if (totalNumInputChans > 32 || totalNumOutputChans > 32)
-			info("Only up to 32 input + 32 output channels are enabled. Higher channel counts are disabled.");
-		totalNumInputChans = min(totalNumInputChans, 32);
-		totalNumOutputChans = min(totalNumOutputChans, 32);
 
-		auto sampleRate = sr;
+		// 0 keeps the rate the driver runs at; a buffer size of 0 (out of range) takes the preferred one
+		auto sampleRate = sr != 0 ? sr : getSampleRate();
 		currentSampleRate = sampleRate;
 
-		updateSampleRates();
+		if (!capsCached)
+			updateSampleRates();
 		bool isListed = std::find(sampleRates.begin(), sampleRates.end(), sampleRate) != sampleRates.end();
 		if (sampleRate == 0 || (sampleRates.size() > 0 && !isListed))
 			sampleRate = sampleRates[0];
@@ -491,13 +436,9 @@ public:
 		// (need to get this again in case a sample rate change affected the channel count)
 		err = asioObject->getChannels(&totalNumInputChans, &totalNumOutputChans);
 		assert(err == ASE_OK);
-		if (totalNumInputChans > 32 || totalNumOutputChans > 32)
-			info("Only up to 32 input + 32 output channels are enabled. Higher channel counts are disabled.");
-		totalNumInputChans = min(totalNumInputChans, 32);
-		totalNumOutputChans = min(totalNumOutputChans, 32);
 
 		if (asioObject->future(kAsioCanReportOverload, nullptr) != ASE_OK)
-			xruns = -1;
+			reportsOverload = false;
 
 		//inBuffers = (float **)calloc(totalNumInputChans + 8, sizeof(float *));
 		//outBuffers = (float **)calloc(totalNumOutputChans + 8, sizeof(float *));
@@ -520,6 +461,10 @@ public:
 		}
 		/* buffers creation; if this fails, try a second time with preferredBufferSize*/
 		auto totalBuffers = totalNumInputChans + totalNumOutputChans;
+		if (!layoutBuffers(max(currentBlockSizeSamples.load(), (int)preferredBufferSize))) {
+			errorstring = "Out of memory";
+			return errorstring;
+		}
 		resetBuffers();
 
 		setCallbackFunctions();
@@ -527,11 +472,11 @@ public:
 		info("disposing buffers");
 		err = asioObject->disposeBuffers();
 
-		info("creating buffers: %i, size: %i", totalBuffers, currentBlockSizeSamples);
+		info("creating buffers: %i, size: %i", totalBuffers, currentBlockSizeSamples.load());
 		err = asioObject->createBuffers(bufferInfos, totalBuffers, currentBlockSizeSamples, &callbacks);
 
 		if (err != ASE_OK) {
-			currentBlockSizeSamples = preferredBufferSize;
+			currentBlockSizeSamples = (int)preferredBufferSize;
 			asioErrorLog("create buffers 2nd attempt", err);
 
 			asioObject->disposeBuffers();
@@ -540,14 +485,11 @@ public:
 
 		if (err == ASE_OK) {
 			buffersCreated = true;
-			ioBufferSpace = (float *)calloc(totalBuffers * currentBlockSizeSamples + 32, sizeof(float));
-			//			silentBuffers = (float *)calloc(currentBlockSizeSamples, sizeof(float));
 
 			std::vector<int> types;
 			currentBitDepth = 16;
 
 			for (int n = 0; n < (int)totalNumInputChans; ++n) {
-				inBuffers[n] = ioBufferSpace + (currentBlockSizeSamples * n);
 				ASIOChannelInfo channelInfo = {};
 				channelInfo.channel = n;
 				channelInfo.isInput = 1;
@@ -555,6 +497,8 @@ public:
 				if (n == 0)
 					types.push_back(channelInfo.type);
 				inputFormat[n] = ASIOSampleFormat(channelInfo.type);
+				if (!inputFormat[n].supported)
+					warn("unsupported ASIO sample type %li, channel %i will be silent", channelInfo.type, n);
 				currentBitDepth = max(currentBitDepth, inputFormat[n].bitDepth);
 			}
 			for (int n = 0; n < (int)totalNumOutputChans; ++n) {
@@ -566,19 +510,37 @@ public:
 				if (n == 0)
 					types.push_back(channelInfo.type);
 				outputFormat[n] = ASIOSampleFormat(channelInfo.type);
+				if (!outputFormat[n].supported)
+					warn("unsupported ASIO sample type %li, channel %i will be silent", channelInfo.type, n);
 				currentBitDepth = max(currentBitDepth, outputFormat[n].bitDepth);
 			}
 
 			info("input sample format: %i, output sample format: %i\n (19 == 32 bit float, 17 == 24 bit int, 18 == 32 bit int)",
 			     types[0], types[1]);
 
+			{
+				// sources read the output rate and the resampler when they publish the client table
+				std::lock_guard<std::mutex> lock(clientsMutex);
+				setupDSD();
+				setupResampler();
+				publishClients(clientList());
+			}
+			startDelivery();
+			periodClock.reset(currentSampleRate, currentBlockSizeSamples);
+			countedPosition = 0;
+			stats.reset();
+			meter.reset((int)totalNumInputChans);
+			droppedSeen = 0;
+			lastCallbackStart = 0;
+			periodNs = (uint64_t)(1e9 * currentBlockSizeSamples / currentSampleRate);
+
 			for (int i = 0; i < totalNumOutputChans; ++i) {
 				//outputFormat[i].clear(bufferInfos[totalNumInputChans + i].buffers[0],
 				//		      currentBlockSizeSamples);
 				//outputFormat[i].clear(bufferInfos[totalNumInputChans + i].buffers[1],
 				//		      currentBlockSizeSamples);
-				bufferInfos[totalNumInputChans + i].buffers[0] = temp0[i];
-				bufferInfos[totalNumInputChans + i].buffers[1] = temp1[i];
+				bufferInfos[totalNumInputChans + i].buffers[0] = temp0 + (size_t)i * bufferFrames;
+				bufferInfos[totalNumInputChans + i].buffers[1] = temp1 + (size_t)i * bufferFrames;
 			}
 
 			readLatencies();
@@ -633,7 +595,7 @@ public:
 	void close()
 	{
 		errorstring.clear();
-		timerstop = true;
+		worker.cancelReset();
 		// stop(); this stops the callbacks, but we're not using explictily callbacks, though it'd be cleaner to do so.
 
 		if (asioObject != nullptr && deviceIsOpen) {
@@ -650,12 +612,9 @@ public:
 				Sleep(10);
 				disposeBuffers();
 			}
-			// this resets the "pseudo callbacks"
-			current_nb_clients = 0;
-			obs_clients.clear();
-
-			Sleep(10);
+			// the clients stay attached: a reopen republishes them for the new layout
 		}
+		stopDelivery();
 	}
 
 	bool isOpen() { return deviceIsOpen || insideControlPanelModalLoop; }
@@ -663,6 +622,12 @@ public:
 
 	int getCurrentBufferSizeSamples() { return currentBlockSizeSamples; }
 	double getCurrentSampleRate() { return currentSampleRate; }
+	/* rate of the pcm delivered to obs; differs from the device rate when decimating DSD */
+	double getOutputSampleRate()
+	{
+		const double rate = currentSampleRate;
+		return dsdInput ? rate / dsdFilter->decimation : rate;
+	}
 	int getCurrentBitDepth() { return currentBitDepth; }
 
 	int getOutputLatencyInSamples() { return outputLatency; }
@@ -671,104 +636,198 @@ public:
 	String getLastError() { return errorstring; }
 	bool hasControlPanel() { return true; }
 
-	bool showControlPanel()
+	/* Returns at once: the panel runs on the worker, the thread the driver lives on, which pumps its messages.
+	 * A reset the driver asks for from the panel is queued behind it.
+	 */
+	void showControlPanel()
 	{
-		info("showing control panel");
-
-		bool done = false;
-		insideControlPanelModalLoop = true;
-		auto started = os_gettime_ns() * 1000;
+		worker.post([this]() {
+			info("showing control panel");
+			insideControlPanelModalLoop = true;
+			auto started = os_gettime_ns() * 1000;
 
-		if (asioObject != nullptr) {
-			asioObject->controlPanel();
+			if (asioObject != nullptr) {
+				asioObject->controlPanel();
 
-			auto spent = (int)(os_gettime_ns() * 1000 - started);
-			debug("spent: %i", spent);
+				auto spent = (int)(os_gettime_ns() * 1000 - started);
+				debug("spent: %i", spent);
 
-			if (spent > 300) {
-				shouldUsePreferredSize = true;
-				done = true;
+				if (spent > 300)
+					shouldUsePreferredSize = true;
 			}
-		}
 
-		insideControlPanelModalLoop = false;
-		return done;
+			insideControlPanelModalLoop = false;
+		});
 	}
 
+	/* Driver message or callback thread: asks for a reopen once the driver has been quiet for 500 ms, so that a burst
+	 * of reset, resync and buffer size messages ends in a single reopen. Never blocks; the worker does the reopen.
+	 */
 	void resetRequest()
 	{
-		int count = 500;
-		while (--count > 0 && !timerstop)
-			Sleep(1);
-		if (!timerstop)
-			timerCallback();
-	}
-
-	void timerCallback()
-	{
-		if (!insideControlPanelModalLoop) {
-			timerstop = true;
-			info("restart request!");
-
-			close();
-			needToReset = true;
-			open(currentSampleRate, currentBlockSizeSamples);
-			reloadChannelNames();
-
-		} else {
-			int count = 100;
-			while (--count > 0 && !timerstop)
-				Sleep(1);
-			if (!timerstop)
-				timerCallback();
-		}
+		// messages sent while the device is being opened are answered by that opening
+		if (!deviceIsOpen)
+			return;
+		worker.scheduleReset(std::chrono::milliseconds(500));
 	}
 
 private:
 	//==============================================================================
 
-	bool bComInitialized = false;
 	IASIO *asioObject = {};
 	ASIOCallbacks callbacks;
 
 	CLSID classId;
+	int slot;
 	String errorstring;
 	std::string deviceName;
 	long totalNumInputChans = 0, totalNumOutputChans = 0;
+	mutable std::mutex infoMutex; // guards the names, rates and sizes below against readers on other threads
 	std::vector<std::string> inputChannelNames;
 	std::vector<std::string> outputChannelNames;
 
 	std::vector<double> sampleRates;
 	std::vector<int> bufferSizes;
 	long inputLatency = 0, outputLatency = 0;
-	long minBufferSize = 0, maxBufferSize = 0, preferredBufferSize = 0, bufferGranularity = 0;
+	long minBufferSize = 0, maxBufferSize = 0, bufferGranularity = 0;
+	std::atomic<long> preferredBufferSize{0}; // read by the sources while the worker opens the device
 	ASIOClockSource clocks[32] = {};
 	int numClockSources = 0;
+	bool capsCached = false; // the above were read from ASIOCapsCache rather than probed
+	String capsKey;          // entry of the driver in the cache
 
-	int currentBlockSizeSamples = 0;
+	// written by the worker, read by the sources and the driver and delivery threads
+	std::atomic<int> currentBlockSizeSamples{0};
 	int currentBitDepth = 16;
-	double currentSampleRate = 0;
-
-	ASIOBufferInfo *bufferInfos;
-	float temp0[32][2048] = {0};
-	float temp1[32][2048] = {0};
-	float *inBuffers[32];
-	float silentBuffers[2048] = {0};
-	float *outBuffers[32];
-	float *ioBufferSpace;
-	ASIOSampleFormat *inputFormat;
-	ASIOSampleFormat *outputFormat;
-
-	bool deviceIsOpen = false, isStarted = false, buffersCreated = false;
+	std::atomic<double> currentSampleRate{0.0};
+
+	/* per-channel buffers, laid out in the arena by layoutBuffers() */
+	ASIOBufferArena arena;
+	int bufferFrames = 0; // frames per channel of the temp & io buffers
+	ASIOBufferInfo *bufferInfos = nullptr;
+	ASIOSampleFormat *inputFormat = nullptr;
+	ASIOSampleFormat *outputFormat = nullptr;
+	float *ioBufferSpace = nullptr;
+	float *temp0 = nullptr; // silent output, bufferFrames per output channel
+	float *temp1 = nullptr;
+	std::vector<float *> outBuffers;
+	std::vector<float> silentBuffer;
+
+	// input channels some client reads and, of these, the ones found silent in the current period; driver thread
+	ASIOChannelMask routedInputs;
+	ASIOChannelMask silentInputs;
+	// converted input channels of the period being delivered; delivery thread
+	std::vector<const float *> inputs;
+
+	std::shared_ptr<const ASIOResampleFilter> resampleFilter;
+	std::vector<ASIOResampler> resamplers; // one per input channel, delivery thread only
+	std::vector<float> resampled;
+	std::vector<int> quietFrames; // silent input frames fed to each resampler since its last signal
+	ASIOPacketizer packetizer; // delivery thread only
+
+	/* smooths the period timestamps handed to obs */
+	ASIOClockDLL periodClock;
+	int64_t countedPosition = 0;
+
+	ASIODeviceStats stats;
+	ASIOLevelMeter meter;
+	uint64_t lastCallbackStart = 0; // driver thread
+	std::atomic<uint64_t> reopenFrom{0}; // end of the audio before a driver requested reopen, 0 if none
+	uint64_t periodNs = 0;
+	uint64_t droppedSeen = 0; // delivery thread
+
+	std::mutex clientsMutex; // serializes writers of the client table
+	ASIOSnapshotPtr<ASIOClientTable> clientTable{new ASIOClientTable()};
+	std::atomic<int> numClients{0};
+
+	/* converted periods travel from the driver thread to the delivery thread, which feeds the obs clients */
+	ASIOBlockRing ring;
+	std::thread deliveryThread;
+	os_sem_t *deliverySem = nullptr;
+	std::atomic<bool> deliveryStop{false};
+
+	bool dsdInput = false, dsdFilterLsbFirst = false;
+	std::shared_ptr<const DSDDecimationFilter> dsdFilter;
+	std::vector<DSDDecimator> dsdDecimators;
+
+	std::atomic<bool> deviceIsOpen{false};
+	bool isStarted = false, buffersCreated = false;
 	std::atomic<bool> calledback{false};
 	bool postOutput = true, needToReset = false;
-	bool insideControlPanelModalLoop = false;
+	std::atomic<bool> insideControlPanelModalLoop{false};
 	bool shouldUsePreferredSize = false;
-	int xruns = 0;
-	std::atomic<bool> timerstop = false;
+	bool reportsOverload = true;
+
+	/* the driver is loaded, opened and closed on this thread so that no caller waits on it */
+	ASIODeviceWorker worker{*this};
+	bool comInitialized = false; // worker thread
 
 	//==============================================================================
 
+	/* Callers hold clientsMutex. */
+	std::vector<struct asio_data *> clientList() const
+	{
+		std::vector<struct asio_data *> list;
+		for (const ASIOClientEntry &client : clientTable.get()->clients)
+			list.push_back(client.data);
+		return list;
+	}
+
+	void publishClients(const std::vector<struct asio_data *> &list)
+	{
+		ASIOClientTable *table = new ASIOClientTable();
+		table->inputs.resize((int)totalNumInputChans);
+
+		// resample on the device only if every source allows it
+		table->resample = resampleFilter && resampleFilter->outRate == get_obs_sample_rate() && !list.empty();
+		for (struct asio_data *data : list)
+			table->resample = table->resample && data->device_resample;
+		table->packetMs = list.empty() ? 0 : list[0]->packet_ms;
+		for (struct asio_data *data : list)
+			table->packetMs = min(table->packetMs, data->packet_ms);
+		const uint32_t rate = table->resample ? (uint32_t)resampleFilter->outRate
+						      : (uint32_t)getOutputSampleRate();
+
+		// the driver buffers go to obs as they are only if every source allows it and none needs them transformed
+		table->direct = !list.empty() && !table->resample && table->packetMs == 0 && !dsdInput;
+		for (struct asio_data *data : list)
+			table->direct = table->direct && data->direct_delivery && !data->mix && !data->fading_mix;
+
+		table->clients.reserve(list.size());
+		for (struct asio_data *data : list) {
+			ASIOClientEntry client = {};
+			client.data = data;
+			client.channels = data->out_channels;
+			client.packet.speakers = (enum speaker_layout)data->out_channels;
+			client.packet.format = AUDIO_FORMAT_FLOAT_PLANAR;
+			client.packet.samples_per_sec = rate;
+			for (int j = 0; j < MAX_AUDIO_CHANNELS; j++) {
+				client.route[j] = j < client.channels ? data->route[j] : -1;
+				if (client.route[j] >= 0)
+					table->inputs.set(client.route[j]);
+			}
+			client.mix = data->mix;
+			if (client.mix) {
+				for (const ASIOMixTerm &t : client.mix->terms)
+					table->inputs.set(t.input);
+			}
+			// the mixer ramps the terms of the replaced matrix down from these, see ASIOMixer::retarget()
+			if (data->fading_mix) {
+				for (const ASIOMixTerm &t : data->fading_mix->terms)
+					table->inputs.set(t.input);
+			}
+			table->clients.push_back(client);
+		}
+		if (table->direct) {
+			table->inputs.forEach([&](int i) {
+				table->direct = table->direct && inputFormat && i < totalNumInputChans &&
+						inputFormat[i].passThrough;
+			});
+		}
+		numClients = (int)list.size();
+		clientTable.publish(table);
+	}
+
 	String getChannelName(int index, bool isInput) const
 	{
 		ASIOChannelInfo channelInfo = {};
@@ -784,30 +843,33 @@ private:
 		long totalInChannels = 0, totalOutChannels = 0;
 
 		if (asioObject != nullptr && asioObject->getChannels(&totalInChannels, &totalOutChannels) == ASE_OK) {
-			if (totalInChannels > 32 || totalOutChannels > 32)
-				info("Only up to 32 input + 32 output channels are enabled. Higher channel counts are disabled.");
-			totalNumInputChans = min(totalInChannels, 32);
-			totalNumOutputChans = min(totalOutChannels, 32);
-
-			inputChannelNames.clear();
-			outputChannelNames.clear();
+			totalNumInputChans = totalInChannels;
+			totalNumOutputChans = totalOutChannels;
 
+			std::vector<std::string> inNames, outNames;
 			for (int i = 0; i < totalNumInputChans; ++i)
-				inputChannelNames.push_back(getChannelName(i, true));
+				inNames.push_back(getChannelName(i, true));
 
 			for (int i = 0; i < totalNumOutputChans; ++i)
-				outputChannelNames.push_back(getChannelName(i, false));
+				outNames.push_back(getChannelName(i, false));
+
+			std::lock_guard<std::mutex> lock(infoMutex);
+			inputChannelNames.swap(inNames);
+			outputChannelNames.swap(outNames);
 		}
 	}
 
 	long refreshBufferSizes()
 	{
-		const auto err = asioObject->getBufferSize(&minBufferSize, &maxBufferSize, &preferredBufferSize,
+		long preferred = 0;
+		const auto err = asioObject->getBufferSize(&minBufferSize, &maxBufferSize, &preferred,
 							   &bufferGranularity);
+		preferredBufferSize = preferred;
 
 		if (err == ASE_OK) {
+			std::lock_guard<std::mutex> lock(infoMutex);
 			bufferSizes.clear();
-			addBufferSizes(minBufferSize, maxBufferSize, preferredBufferSize, bufferGranularity);
+			addBufferSizes(minBufferSize, maxBufferSize, preferred, bufferGranularity);
 		}
 
 		return err;
@@ -854,6 +916,40 @@ private:
 		return bufferSizeSamples;
 	}
 
+	/* Lays the per-channel buffers out in the arena for the current channel counts and periods of up to numFrames
+	 * frames. Only call while the device is stopped: every buffer moves and is cleared.
+	 */
+	bool layoutBuffers(int numFrames)
+	{
+		const size_t numIns = max((int)totalNumInputChans, 1);
+		const size_t numOuts = max((int)totalNumOutputChans, 2); // the dummy buffers use 2 outputs
+		const size_t numChans = numIns + numOuts;
+		const size_t frames = max(numFrames, 1);
+
+		const size_t bytes = ASIOBufferArena::footprint<ASIOBufferInfo>(numChans) +
+				     ASIOBufferArena::footprint<ASIOSampleFormat>(numIns) +
+				     ASIOBufferArena::footprint<ASIOSampleFormat>(numOuts) +
+				     ASIOBufferArena::footprint<float>(numChans * frames) +
+				     2 * ASIOBufferArena::footprint<float>(numOuts * frames);
+		if (!arena.begin(bytes)) {
+			error("could not allocate %zu bytes of buffers", bytes);
+			bufferInfos = nullptr;
+			inputFormat = outputFormat = nullptr;
+			ioBufferSpace = temp0 = temp1 = nullptr;
+			bufferFrames = 0;
+			return false;
+		}
+		bufferInfos = arena.take<ASIOBufferInfo>(numChans);
+		inputFormat = arena.take<ASIOSampleFormat>(numIns);
+		outputFormat = arena.take<ASIOSampleFormat>(numOuts);
+		ioBufferSpace = arena.take<float>(numChans * frames);
+		temp0 = arena.take<float>(numOuts * frames);
+		temp1 = arena.take<float>(numOuts * frames);
+		bufferFrames = (int)frames;
+		outBuffers.assign(totalNumOutputChans, nullptr);
+		return true;
+	}
+
 	void resetBuffers()
 	{
 		for (int i = 0; i < totalNumInputChans; ++i) {
@@ -901,7 +997,7 @@ private:
 	void setSampleRate(double newRate)
 	{
 		if (currentSampleRate != newRate) {
-			info("rate change: %i to %i", currentSampleRate, newRate);
+			info("rate change: %i to %i", (int)currentSampleRate, (int)newRate);
 			auto err = asioObject->setSampleRate(newRate);
 			asioErrorLog("setSampleRate", err);
 			Sleep(10);
@@ -967,8 +1063,117 @@ private:
 			info("Latencies: in = %i, out = %i", (int)inputLatency, (int)outputLatency);
 	}
 
+	/* Restores the description of the driver saved by a previous probe. */
+	void applyCaps(const ASIODriverCaps &caps)
+	{
+		minBufferSize = caps.minBufferSize;
+		maxBufferSize = caps.maxBufferSize;
+		preferredBufferSize = caps.preferredBufferSize;
+		bufferGranularity = caps.bufferGranularity;
+		inputLatency = caps.inputLatency;
+		outputLatency = caps.outputLatency;
+
+		memset(clocks, 0, sizeof(clocks));
+		numClockSources = min((int)caps.clocks.size(), 32);
+		for (int i = 0; i < numClockSources; i++) {
+			const ASIOCachedClock &clock = caps.clocks[i];
+			clocks[i].index = clock.index;
+			clocks[i].associatedChannel = clock.channel;
+			clocks[i].associatedGroup = clock.group;
+			clocks[i].isCurrentSource = clock.current ? ASIOTrue : ASIOFalse;
+			strncpy(clocks[i].name, clock.name.c_str(), sizeof(clocks[i].name) - 1);
+		}
+
+		std::lock_guard<std::mutex> lock(infoMutex);
+		sampleRates = caps.sampleRates;
+		inputChannelNames = caps.inputNames;
+		outputChannelNames = caps.outputNames;
+		bufferSizes.clear();
+		addBufferSizes(minBufferSize, maxBufferSize, caps.preferredBufferSize, bufferGranularity);
+	}
+
+	/* Collects what was just probed, for the cache. */
+	ASIODriverCaps probedCaps()
+	{
+		ASIODriverCaps caps;
+		caps.numInputs = totalNumInputChans;
+		caps.numOutputs = totalNumOutputChans;
+		caps.minBufferSize = minBufferSize;
+		caps.maxBufferSize = maxBufferSize;
+		caps.preferredBufferSize = preferredBufferSize;
+		caps.bufferGranularity = bufferGranularity;
+		caps.inputLatency = inputLatency;
+		caps.outputLatency = outputLatency;
+		{
+			std::lock_guard<std::mutex> lock(infoMutex);
+			caps.sampleRates = sampleRates;
+			caps.inputNames = inputChannelNames;
+			caps.outputNames = outputChannelNames;
+		}
+
+		ASIOClockSource sources[32] = {};
+		long numSources = 32;
+		if (asioObject->getClockSources(sources, &numSources) == ASE_OK) {
+			for (int i = 0; i < min((int)numSources, 32); i++) {
+				ASIOCachedClock clock;
+				clock.index = sources[i].index;
+				clock.channel = sources[i].associatedChannel;
+				clock.group = sources[i].associatedGroup;
+				clock.current = sources[i].isCurrentSource == ASIOTrue;
+				clock.name.assign(sources[i].name, strnlen(sources[i].name, sizeof(sources[i].name)));
+				caps.clocks.push_back(clock);
+			}
+		}
+		return caps;
+	}
+
+	/* The probe cubase runs when it opens a driver: some devices fail if these steps are left out. */
+	long probeDriver()
+	{
+		long err = refreshBufferSizes();
+		if (err != 0)
+			return err;
+		setDefaultSampleRate();
+		updateSampleRates();
+		// ..doing these steps because cubase does so at this stage
+		// in initialisation, and some devices fail if we don't.
+		readLatencies();
+		createDummyBuffers(preferredBufferSize);
+		readLatencies();
+
+		// start and stop because cubase does it..
+		err = asioObject->start();
+		// ignore an error here, as it might start later after setting other stuff up
+		asioErrorLog("start", err);
+
+		Sleep(80);
+		asioObject->stop();
+		return 0;
+	}
+
+	void setDefaultSampleRate()
+	{
+		auto currentRate = getSampleRate();
+
+		if (currentRate < 1.0 || currentRate > 192001.0) {
+			info("setting default sample rate");
+			const long err = asioObject->setSampleRate(48000.0);
+			asioErrorLog("setting sample rate", err);
+			// sanity check
+			currentRate = getSampleRate();
+		}
+
+		currentSampleRate = currentRate;
+		postOutput = (asioObject->outputReady() == 0);
+
+		if (postOutput)
+			info("outputReady true");
+	}
+
 	void createDummyBuffers(long preferredSize)
 	{
+		if (!layoutBuffers((int)preferredSize))
+			return;
 
 		for (int i = 0; i < min(2, (int)totalNumInputChans); ++i) {
 			bufferInfos[i].isInput = 1;
@@ -992,13 +1197,11 @@ private:
 
 		long newInps = 0, newOuts = 0;
 		asioObject->getChannels(&newInps, &newOuts);
-		if (newInps > 32 || newOuts > 32)
-			info("Only up to 32 input + 32 output channels are enabled. Higher channel counts are disabled.");
-		totalNumInputChans = min(newInps, 32);
-		totalNumOutputChans = min(newOuts, 32);
 		if (totalNumInputChans != newInps || totalNumOutputChans != newOuts) {
 			totalNumInputChans = newInps;
 			totalNumOutputChans = newOuts;
+			if (!layoutBuffers(preferredSize))
+				return;
 
 			info("checking channel numbers after buffer creation: %i channels in, %i channels out",
 			     (int)totalNumInputChans, (int)totalNumOutputChans);
@@ -1020,8 +1223,8 @@ private:
 				//		      preferredBufferSize);
 				//outputFormat[i].clear(bufferInfos[outputBufferIndex + i].buffers[1],
 				//		      preferredBufferSize);
-				bufferInfos[outputBufferIndex + i].buffers[0] = temp0[i];
-				bufferInfos[outputBufferIndex + i].buffers[1] = temp1[i];
+				bufferInfos[outputBufferIndex + i].buffers[0] = temp0 + (size_t)i * bufferFrames;
+				bufferInfos[outputBufferIndex + i].buffers[1] = temp1 + (size_t)i * bufferFrames;
 			}
 		}
 	}
@@ -1112,14 +1315,17 @@ private:
 		info("opening device: %s", getName().c_str());
 
 		needToReset = false;
-		outputChannelNames.clear();
-		inputChannelNames.clear();
-		bufferSizes.clear();
-		sampleRates.clear();
+		{
+			std::lock_guard<std::mutex> lock(infoMutex);
+			outputChannelNames.clear();
+			inputChannelNames.clear();
+			bufferSizes.clear();
+			sampleRates.clear();
+		}
 		deviceIsOpen = false;
 		totalNumInputChans = 0;
 		totalNumOutputChans = 0;
-		xruns = 0;
+		reportsOverload = true;
 		errorstring.clear();
 
 		if (getName().empty())
@@ -1137,51 +1343,27 @@ private:
 				    (err = asioObject->getChannels(&totalNumInputChans, &totalNumOutputChans)) == 0) {
 					info(" channels in: %i, channels out: %i", totalNumInputChans,
 					     totalNumOutputChans);
-					if (totalNumInputChans > 32 || totalNumOutputChans > 32)
-						info("Only up to 32 input + 32 output channels are enabled. Higher channel counts are disabled.");
-					totalNumInputChans = min(totalNumInputChans, 32);
-					totalNumOutputChans = min(totalNumOutputChans, 32);
-
-					const int chansToAllocate = totalNumInputChans + totalNumOutputChans + 4;
-					/* allocate buffers */
-					bufferInfos = (ASIOBufferInfo *)calloc(chansToAllocate, sizeof(ASIOBufferInfo));
-					inputFormat =
-						(ASIOSampleFormat *)calloc(chansToAllocate, sizeof(ASIOSampleFormat));
-					outputFormat =
-						(ASIOSampleFormat *)calloc(chansToAllocate, sizeof(ASIOSampleFormat));
-
-					if ((err = refreshBufferSizes()) == 0) {
-						auto currentRate = getSampleRate();
-
-						if (currentRate < 1.0 || currentRate > 192001.0) {
-							info("setting default sample rate");
-							err = asioObject->setSampleRate(48000.0);
-							asioErrorLog("setting sample rate", err);
-							// sanity check
-							currentRate = getSampleRate();
-						}
-
-						currentSampleRate = currentRate;
-						postOutput = (asioObject->outputReady() == 0);
-
-						if (postOutput)
-							info("outputReady true");
-
-						updateSampleRates();
-						// ..doing these steps because cubase does so at this stage
-						// in initialisation, and some devices fail if we don't.
-						readLatencies();
-						createDummyBuffers(preferredBufferSize);
-						readLatencies();
-
-						// start and stop because cubase does it..
-						err = asioObject->start();
-						// ignore an error here, as it might start later after setting other stuff up
-						asioErrorLog("start", err);
-
-						Sleep(80);
-						asioObject->stop();
-					} else {
+
+					/* A driver already probed with this version, with as many channels as now,
+					 * opens without being probed: the sample rates, buffer sizes, names, latencies
+					 * and clocks come from the cache. A reset requested by the driver probes it
+					 * again, see reopenDriver().
+					 */
+					capsKey = ASIOCapsCache::key(clsidString(classId),
+								     asioObject->getDriverVersion());
+					ASIODriverCaps caps;
+					const auto probe = [&](ASIODriverCaps &probed) {
+						err = probeDriver();
+						probed = probedCaps();
+						return err == 0;
+					};
+					capsCached = capsCache().probeOrLoad(capsKey, totalNumInputChans,
+									     totalNumOutputChans, caps, probe);
+					if (capsCached) {
+						info("driver capabilities read from the cache");
+						applyCaps(caps);
+						setDefaultSampleRate();
+					} else if (err != 0) {
 						errorstring = "Can't detect buffer sizes";
 					}
 				} else {
@@ -1210,10 +1392,279 @@ private:
 
 		deviceIsOpen = false;
 		needToReset = false;
-		timerstop = true;
 		return errorstring;
 	}
 
+	/* Drivers in DSD mode report the DSD bit rate as their sample rate and deliver 1-bit samples; these are
+	 * decimated to pcm on the driver thread before reaching the clients.
+	 */
+	void setupDSD()
+	{
+		dsdInput = totalNumInputChans > 0 && inputFormat[0].isDSD;
+		dsdDecimators.clear();
+		if (!dsdInput)
+			return;
+
+		const int decimation = DSDDecimationFilter::decimationForRate(currentSampleRate);
+		if (!dsdFilter || dsdFilter->decimation != decimation ||
+		    dsdFilterLsbFirst != inputFormat[0].littleEndian) {
+			dsdFilterLsbFirst = inputFormat[0].littleEndian;
+			dsdFilter = std::make_shared<const DSDDecimationFilter>(decimation, dsdFilterLsbFirst);
+		}
+		for (int n = 0; n < (int)totalNumInputChans; ++n)
+			dsdDecimators.emplace_back(dsdFilter, !inputFormat[n].packedDSD);
+
+		info("DSD input at %i Hz, decimating by %i to %i Hz", (int)currentSampleRate, decimation,
+		     (int)getOutputSampleRate());
+	}
+
+	/* The ring holds about 100 ms of audio so that a stall in libobs never reaches the driver thread. */
+	void startDelivery()
+	{
+		stopDelivery();
+		const int slots = (int)(currentSampleRate * 0.1 / max(currentBlockSizeSamples.load(), 1)) + 1;
+		ring.resize(min(max(slots, 8), 256), (int)totalNumInputChans, currentBlockSizeSamples);
+		packetizer.reset((int)totalNumInputChans, 0);
+		inputs.assign(totalNumInputChans, nullptr);
+		routedInputs.resize((int)totalNumInputChans);
+		silentInputs.resize((int)totalNumInputChans);
+		const int frames = currentBlockSizeSamples;
+		silentBuffer.assign(resampleFilter ? max(resampleFilter->maxOutput(frames), frames) : frames,
+				    0.0f);
+		if (os_sem_init(&deliverySem, 0) != 0) {
+			error("could not create the delivery semaphore");
+			deliverySem = nullptr;
+			return;
+		}
+		deliveryStop = false;
+		deliveryThread = std::thread([this]() { deliveryLoop(); });
+	}
+
+	void stopDelivery()
+	{
+		if (!deliveryThread.joinable())
+			return;
+		deliveryStop = true;
+		os_sem_post(deliverySem);
+		deliveryThread.join();
+		os_sem_destroy(deliverySem);
+		deliverySem = nullptr;
+		if (stats.callbacks)
+			info("%s: %s", deviceName.c_str(), stats.summary().c_str());
+	}
+
+	void deliveryLoop()
+	{
+		const uint64_t logInterval = 60000000000ULL; // 1 min
+		uint64_t lastLog = os_gettime_ns();
+
+		os_set_thread_name("asio delivery");
+		while (!deliveryStop) {
+			os_sem_wait(deliverySem);
+			while (ASIOAudioBlock *block = ring.beginRead()) {
+				deliver(*block);
+				ring.endRead();
+			}
+			const uint64_t now = os_gettime_ns();
+			if (now - lastLog >= logInterval) {
+				lastLog = now;
+				info("%s: %s", deviceName.c_str(), stats.summary().c_str());
+			}
+		}
+	}
+
+	void deliver(const ASIOAudioBlock &block)
+	{
+		// periods dropped by the callback since the last delivery are accounted to every listening client
+		const uint64_t dropped = stats.droppedPeriods.load(std::memory_order_relaxed);
+		const uint64_t lostFrames = (dropped - droppedSeen) * block.frames;
+		droppedSeen = dropped;
+
+		const int epoch = clientTable.enter();
+		const ASIOClientTable *table = clientTable.get();
+
+		// converted, and resampled when enabled, input channels; nullptr for the ones not converted
+		int frames = block.frames;
+		if (table->resample && resampleFilter) {
+			frames = resampleInputs(block);
+		} else {
+			for (int i = 0; i < (int)inputs.size(); i++)
+				inputs[i] = block.routed.test(i) ? ring.channel(block, i) : nullptr;
+		}
+		const double rate = table->resample && resampleFilter ? resampleFilter->outRate : getOutputSampleRate();
+
+		const int packetFrames = (int)(table->packetMs * rate / 1000.0 + 0.5);
+		if (packetFrames != packetizer.size()) {
+			packetizer.reset((int)totalNumInputChans, packetFrames);
+			if ((int)silentBuffer.size() < packetFrames)
+				silentBuffer.assign(packetFrames, 0.0f);
+		}
+		packetizer.push(inputs.data(), frames, block.timestamp, rate);
+
+		while (const ASIOPacket *packet = packetizer.pop()) {
+			for (const ASIOClientEntry &client : table->clients) {
+				struct asio_data *data = client.data;
+				if (data->stopping || !data->active || !data->source)
+					continue;
+				obs_source_audio out = client.packet;
+				out.timestamp = packet->timestamp;
+				out.frames = packet->frames;
+				// a matrix removed from the source fades out over the next packets
+				const bool mixing = data->mixer && (client.mix || data->mixer->active());
+				if (mixing)
+					data->mixer->process(client.mix, client.route, packet->channels.data(),
+							     (int)packet->channels.size(), packet->frames, rate);
+				for (int j = 0; j < client.channels; j++) {
+					const int route = client.route[j];
+					// routing may have changed since the period was converted
+					if (mixing && data->mixer->mixes(j))
+						out.data[j] = (uint8_t *)data->mixer->output(j);
+					else if (route >= 0 && route < (int)packet->channels.size() && packet->channels[route])
+						out.data[j] = (uint8_t *)packet->channels[route];
+					else
+						out.data[j] = (uint8_t *)silentBuffer.data();
+				}
+				obs_source_output_audio(data->source, &out);
+				data->frames_delivered.fetch_add(packet->frames, std::memory_order_relaxed);
+			}
+		}
+		if (lostFrames) {
+			for (const ASIOClientEntry &client : table->clients)
+				if (!client.data->stopping && client.data->active)
+					client.data->frames_dropped.fetch_add(lostFrames, std::memory_order_relaxed);
+		}
+		clientTable.leave(epoch);
+	}
+
+	/* Driver thread: passes the driver buffers of native float inputs to the sources as they are, without the copy
+	 * into the ring. obs_source_output_audio() copies the samples before returning, so the half-buffer only has to
+	 * stay valid during the call. Opt-in, since a stall in libobs then reaches the driver thread.
+	 */
+	void deliverDirect(const ASIOClientTable &table, long bufferIndex, int frames, uint64_t timestamp)
+	{
+		routedInputs.forEach([&](int i) {
+			meter.measure(i, (const float *)bufferInfos[i].buffers[bufferIndex], frames);
+		});
+		for (const ASIOClientEntry &client : table.clients) {
+			struct asio_data *data = client.data;
+			if (data->stopping || !data->active || !data->source)
+				continue;
+			obs_source_audio out = client.packet;
+			out.timestamp = timestamp;
+			out.frames = frames;
+			for (int j = 0; j < client.channels; j++) {
+				const int route = client.route[j];
+				if (route >= 0 && route < totalNumInputChans)
+					out.data[j] = (uint8_t *)bufferInfos[route].buffers[bufferIndex];
+				else
+					out.data[j] = (uint8_t *)silentBuffer.data();
+			}
+			obs_source_output_audio(data->source, &out);
+			data->frames_delivered.fetch_add(frames, std::memory_order_relaxed);
+		}
+	}
+
+	/* When the device runs at another rate than obs, the inputs are resampled once per channel on the delivery thread
+	 * rather than by libobs once per source.
+	 */
+	void setupResampler()
+	{
+		const int inRate = (int)getOutputSampleRate();
+		const int outRate = get_obs_sample_rate();
+
+		resamplers.clear();
+		if (outRate <= 0 || inRate == outRate || (double)inRate != getOutputSampleRate()) {
+			resampleFilter.reset();
+			return;
+		}
+		if (!resampleFilter || resampleFilter->inRate != inRate || resampleFilter->outRate != outRate)
+			resampleFilter = std::make_shared<const ASIOResampleFilter>(inRate, outRate);
+		if (!resampleFilter->valid()) {
+			warn("no device resampling from %i Hz to %i Hz, obs will resample each source", inRate, outRate);
+			resampleFilter.reset();
+			return;
+		}
+		for (int n = 0; n < (int)totalNumInputChans; ++n)
+			resamplers.emplace_back(resampleFilter, currentBlockSizeSamples);
+		quietFrames.assign(totalNumInputChans, 0);
+		resampled.assign((size_t)totalNumInputChans * resampleFilter->maxOutput(currentBlockSizeSamples), 0.0f);
+		info("device resampling from %i Hz to %i Hz (%i taps)", inRate, outRate, resampleFilter->taps);
+	}
+
+	/* Resamples the converted channels of a period and keeps the others in step; returns the number of frames. */
+	int resampleInputs(const ASIOAudioBlock &block)
+	{
+		const int stride = resampleFilter->maxOutput(ring.maxFrames());
+		int frames = 0;
+
+		for (int i = 0; i < (int)resamplers.size(); i++) {
+			float *dest = resampled.data() + (size_t)i * stride;
+			inputs[i] = nullptr;
+			if (block.routed.test(i)) {
+				frames = resamplers[i].process(ring.channel(block, i), block.frames, dest);
+				inputs[i] = dest;
+				quietFrames[i] = 0;
+			} else if (block.silent.test(i) && quietFrames[i] < resampleFilter->taps) {
+				// let the filter ring out after the signal stopped
+				frames = resamplers[i].process(silentBuffer.data(), block.frames, dest);
+				inputs[i] = dest;
+				quietFrames[i] += block.frames;
+			} else {
+				frames = resamplers[i].skip(block.frames);
+			}
+		}
+		return frames;
+	}
+
+	/* ASIOWorkerDriver, on the worker thread */
+	void workerStarted() override
+	{
+		comInitialized = SUCCEEDED(CoInitialize(nullptr));
+		os_set_thread_name("asio device");
+	}
+
+	void workerStopping() override
+	{
+		close();
+		if (!removeCurrentDriver())
+			info("** Driver crashed while being closed");
+		if (comInitialized)
+			CoUninitialize();
+	}
+
+	void openQueued() override { calledback = false; }
+
+	String openDriver(double sr, int bufferSizeSamples) override
+	{
+		// a close was skipped because a source attached again before it ran: the device runs as asked
+		if (sr == 0 && bufferSizeSamples == 0 && deviceIsOpen)
+			return String();
+		return open(sr, bufferSizeSamples);
+	}
+
+	void closeDriver() override { close(); }
+	bool driverOpen() override { return deviceIsOpen; }
+	int attachedClients() override { return getNumClients(); }
+
+	/* Reopens the device with its current settings after the driver asked for it. */
+	String reopenDriver() override
+	{
+		info("restart request!");
+		close();
+		// the driver is stopped: the audio stopped at the end of the last period, the gap runs from there
+		if (lastCallbackStart)
+			reopenFrom = lastCallbackStart + periodNs;
+		needToReset = true;
+		capsCached = false; // the reset may have changed the rates, sizes and names: probe them again
+		const String err = open(currentSampleRate, currentBlockSizeSamples);
+		reloadChannelNames();
+		if (err.empty() && !capsKey.empty()) {
+			capsCache().store(capsKey, probedCaps());
+			capsCached = true;
+		}
+		return err;
+	}
+
 	void disposeBuffers()
 	{
 		if (asioObject != nullptr && buffersCreated) {
@@ -1223,12 +1674,12 @@ private:
 	}
 
 	//==============================================================================
-	void ASIOCALLBACK callback(long index)
+	void ASIOCALLBACK callback(long index, const ASIOTime *time = nullptr)
 	{
 		if (isStarted) {
 			if (index >= 0)
 				if (!shutting_down_atomic)
-					processBuffer(index);
+					processBuffer(index, time);
 				else
 					os_sem_post(shutting_down);
 		} else {
@@ -1238,49 +1689,70 @@ private:
 		calledback = true;
 	}
 
-	void processBuffer(long bufferIndex)
+	void processBuffer(long bufferIndex, const ASIOTime *time)
 	{
+		const uint64_t now = os_gettime_ns();
 		ASIOBufferInfo *infos = bufferInfos;
 		int samps = currentBlockSizeSamples;
-
-		// convert to float the samples retrieved from the device
-		for (int i = 0; i < (int)totalNumInputChans; ++i) {
-			if (inBuffers[i] != nullptr) {
-				inputFormat[i].convertToFloat(infos[i].buffers[bufferIndex], inBuffers[i], samps);
+		const uint64_t timestamp = periodClock.update(getSamplePosition(time), now);
+
+		// convert to float the samples retrieved from the device, but only for the channels some client reads
+		const int epoch = clientTable.enter();
+		const ASIOClientTable *table = clientTable.get();
+		routedInputs.assign(table->inputs);
+		// once the delivery thread caught up, so that no period overtakes one still in the ring
+		const bool direct = table->direct && ring.drained();
+		if (direct)
+			deliverDirect(*table, bufferIndex, samps, timestamp);
+		clientTable.leave(epoch);
+		silentInputs.clear();
+
+		ASIOAudioBlock *block = direct ? nullptr : ring.beginWrite();
+		if (direct) {
+			// nothing to convert, the sources already got the driver buffers
+		} else if (!block) {
+			stats.droppedPeriods.fetch_add(1, std::memory_order_relaxed);
+			// obs is stalled; drop the period but keep the DSD decimators in phase
+			if (dsdInput) {
+				for (DSDDecimator &d : dsdDecimators)
+					d.skip(inputFormat[0].packedDSD ? samps / 8 : samps);
 			}
-		}
-		// pass audio to obs clients
-		struct obs_audio_info aoi;
-		obs_get_audio_info(&aoi);
-		int output_channels = get_obs_output_channels();
-
-		obs_source_audio out;
-		out.speakers = aoi.speakers;
-		out.format = AUDIO_FORMAT_FLOAT_PLANAR;
-		out.samples_per_sec = (uint32_t)getCurrentSampleRate();
-		out.timestamp = os_gettime_ns();
-		out.frames = samps;
-
-		for (int idx = 0; idx < obs_clients.size(); idx++) {
-			if (obs_clients[idx] != nullptr) {
-				if (obs_clients[idx]->device) {
-					output_channels = obs_clients[idx]->out_channels;
-					out.speakers = (enum speaker_layout)output_channels;
-					for (int j = 0; j < output_channels; j++) {
-						if (obs_clients[idx] != nullptr) {
-							if (obs_clients[idx]->route[j] >= 0 &&
-							    !obs_clients[idx]->stopping)
-								out.data[j] = (uint8_t *)
-									inBuffers[obs_clients[idx]->route[j]];
-							else
-								out.data[j] = (uint8_t *)silentBuffers;
-						}
-					}
-					if (!obs_clients[idx]->stopping && obs_clients[idx]->source &&
-					    obs_clients[idx]->active)
-						obs_source_output_audio(obs_clients[idx]->source, &out);
-				}
+		} else if (dsdInput) {
+			const int dsdBytes = inputFormat[0].packedDSD ? samps / 8 : samps;
+			int frames = 0;
+			routedInputs.forEach([&](int i) {
+				frames = dsdDecimators[i].process(infos[i].buffers[bufferIndex], dsdBytes,
+								  ring.channel(*block, i));
+				meter.measure(i, ring.channel(*block, i), frames);
+			});
+			// keep the decimation phase of idle channels aligned with the routed ones
+			for (int i = 0; i < (int)totalNumInputChans; i++) {
+				if (!routedInputs.test(i))
+					dsdDecimators[i].skip(dsdBytes);
 			}
+			samps = frames;
+		} else {
+			// a digitally silent channel is neither converted nor copied, the delivery uses silence instead
+			routedInputs.forEach([&](int i) {
+				const void *src = infos[i].buffers[bufferIndex];
+				if (ASIOLevelMeter::isSilent(src, (size_t)samps * inputFormat[i].byteStride)) {
+					silentInputs.set(i);
+					meter.silence(i);
+					return;
+				}
+				inputFormat[i].toFloat(src, ring.channel(*block, i), samps);
+				meter.measure(i, ring.channel(*block, i), samps);
+			});
+		}
+		// hand the period to the delivery thread
+		if (block && samps > 0) {
+			block->frames = samps;
+			block->routed.assign(routedInputs);
+			block->routed.remove(silentInputs);
+			block->silent.assign(silentInputs);
+			block->timestamp = timestamp;
+			ring.endWrite();
+			os_sem_post(deliverySem);
 		}
 		// Writing silent audio : the outBuffers were calloc'd so they're silent.
 		// The convertFromFloat could probably be just a cast ... but for the sake of streaming audio later, let's leave it like that.
@@ -1290,14 +1762,40 @@ private:
 				infos[totalNumInputChans + i].buffers[bufferIndex] = temp0;
 		}
 
-		if (obs_clients.size() == 0) {
+		if (numClients == 0) {
 			for (int i = 0; i < totalNumOutputChans; ++i)
 				infos[totalNumInputChans + i].buffers[bufferIndex] = temp0;
-			// we assume bytestride is <= 32 if it's larger we're fucked since we allocated only 32 x 2048
 		}
 
 		if (postOutput)
 			asioObject->outputReady();
+
+		if (!lastCallbackStart) {
+			// first period since the device started; after a reopen, account for the audio missed meanwhile
+			const uint64_t from = reopenFrom.exchange(0, std::memory_order_relaxed);
+			if (from && now > from)
+				stats.recordReopen(now - from);
+		}
+		stats.recordCallback(now, os_gettime_ns(), lastCallbackStart, periodNs);
+		lastCallbackStart = now;
+	}
+
+	/* Sample position of the current period: from the time info passed to bufferSwitchTimeInfo, else asked to the
+	 * driver, else counted.
+	 */
+	int64_t getSamplePosition(const ASIOTime *time)
+	{
+		int64_t position = countedPosition;
+		countedPosition += currentBlockSizeSamples;
+
+		if (time && (time->timeInfo.flags & kSamplePositionValid))
+			return asio64bit(time->timeInfo.samplePosition.hi, time->timeInfo.samplePosition.lo);
+
+		ASIOSamples samples;
+		ASIOTimeStamp stamp;
+		if (asioObject->getSamplePosition(&samples, &stamp) == ASE_OK)
+			return asio64bit(samples.hi, samples.lo);
+		return position;
 	}
 
 	long asioMessagesCallback(long selector, long value)
@@ -1329,10 +1827,11 @@ private:
 			return 2;
 
 		case kAsioSupportsTimeInfo:
+			return 1;
 		case kAsioSupportsTimeCode:
 			return 0;
 		case kAsioOverload:
-			++xruns;
+			stats.xruns.fetch_add(1, std::memory_order_relaxed);
 			return 1;
 		}
 
@@ -1341,10 +1840,10 @@ private:
 
 	//==============================================================================
 	template<int deviceIndex> struct ASIOCallbackFunctions {
-		static ASIOTime *ASIOCALLBACK bufferSwitchTimeInfoCallback(ASIOTime *, long index, long)
+		static ASIOTime *ASIOCALLBACK bufferSwitchTimeInfoCallback(ASIOTime *time, long index, long)
 		{
 			if (auto *d = currentASIODev[deviceIndex])
-				d->callback(index);
+				d->callback(index, time);
 
 			return {};
 		}
@@ -1412,50 +1911,29 @@ std::string TCHARToUTF8(const TCHAR *ptr)
 	return res;
 #endif
 }
-struct AsioDriver {
-	std::string name;
-	std::string clsid;
-};
-
-class ASIOAudioIODeviceList {
-private:
-	bool hasScanned = false;
-	std::vector<std::string> blacklisted = {"ASIO DirectX Full Duplex", "ASIO Multimedia Driver"};
-
-	bool isBlacklistedDriver(const std::string &driverName)
-	{
-		bool result = false;
-		for (int i = 0; i < (int)blacklisted.size(); i++)
-			result = result || (blacklisted[i].find(driverName) != std::string::npos);
-		return result;
-	}
-
+/* Lists the drivers registered under HKLM\SOFTWARE\ASIO and watches that key for drivers being installed or removed,
+ * e.g. when a USB interface is plugged in.
+ */
+class ASIORegistryDriverSource : public ASIODriverSource {
 public:
-	std::vector<std::string> deviceNames;
-	std::vector<CLSID> classIds;
-	std::vector<struct AsioDriver> drivers;
-	ASIOAudioIODeviceList()
+	ASIORegistryDriverSource()
 	{
-		// initialization code
-		deviceNames = {};
-		classIds = {};
-		drivers = {};
+		stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		changeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 	}
 
-	~ASIOAudioIODeviceList()
+	~ASIORegistryDriverSource()
 	{
-		for (int i = 0; i < maxNumASIODevices; i++) {
-			if (currentASIODev[i])
-				delete currentASIODev[i];
-		}
+		if (watchedKey)
+			RegCloseKey(watchedKey);
+		if (changeEvent)
+			CloseHandle(changeEvent);
+		if (stopEvent)
+			CloseHandle(stopEvent);
 	}
 
-	void scanForDevices()
+	bool enumerate(std::vector<AsioDriver> &drivers) override
 	{
-		hasScanned = true;
-		deviceNames.clear();
-		classIds.clear();
-
 		HKEY asio;
 		DWORD index = 0, nameSize = 256, valueSize = 256;
 		LONG err;
@@ -1466,7 +1944,7 @@ public:
 		if (!SUCCEEDED(err = RegOpenKeyEx(HKEY_LOCAL_MACHINE, TEXT("SOFTWARE\\ASIO"), 0, KEY_READ, &asio))) {
 
 			error("ASIO Error: Failed to open HKLM\\SOFTWARE\\ASIO: status %i", err);
-			return;
+			return false;
 		}
 
 		while ((err = RegEnumKeyEx(asio, index++, name, &nameSize, nullptr, nullptr, nullptr, nullptr)) ==
@@ -1488,8 +1966,10 @@ public:
 				continue;
 			}
 			CLSID localclsid;
-			if (CLSIDFromString((LPOLESTR)value, &localclsid) == S_OK)
-				classIds.push_back(localclsid);
+			if (CLSIDFromString((LPOLESTR)value, &localclsid) != S_OK) {
+				error("Registry Error: Skipping key %s: invalid CLSID\n", name);
+				continue;
+			}
 
 			driver.clsid = TCHARToUTF8(value);
 			valueSize = 256;
@@ -1510,60 +1990,137 @@ public:
 
 			info("Found ASIO driver: %s with CLSID %s\n", driver.name.c_str(), driver.clsid.c_str());
 			drivers.push_back(driver);
-			deviceNames.push_back(driver.name);
 		}
 
 		info("ASIO Info: Done querying ASIO drivers.");
 
 		RegCloseKey(asio);
+		return true;
 	}
 
-	static int findFreeSlot()
+	bool waitForChange() override
 	{
-		for (int i = 0; i < maxNumASIODevices; ++i)
-			if (currentASIODev[i] == nullptr)
-				return i;
+		if (!stopEvent || !changeEvent)
+			return false;
+		// the notification is bound to this thread, which must outlive it: only the watcher thread waits here
+		if (!watchedKey &&
+		    RegOpenKeyEx(HKEY_LOCAL_MACHINE, TEXT("SOFTWARE\\ASIO"), 0, KEY_NOTIFY, &watchedKey) != ERROR_SUCCESS) {
+			watchedKey = nullptr;
+			return false;
+		}
+		if (RegNotifyChangeKeyValue(watchedKey, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+					    changeEvent, TRUE) != ERROR_SUCCESS)
+			return false;
+
+		HANDLE events[2] = {stopEvent, changeEvent};
+		if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+			return false;
+		// an installer writes several keys in a row: let it finish before rescanning
+		return WaitForSingleObject(stopEvent, 500) == WAIT_TIMEOUT;
+	}
+
+	void cancel() override
+	{
+		if (stopEvent)
+			SetEvent(stopEvent);
+	}
+
+private:
+	HANDLE stopEvent = nullptr;
+	HANDLE changeEvent = nullptr;
+	HKEY watchedKey = nullptr;
+
+	bool isBlacklistedDriver(const std::string &driverName)
+	{
+		static const std::vector<std::string> blacklisted = {"ASIO DirectX Full Duplex",
+								     "ASIO Multimedia Driver"};
+		bool result = false;
+		for (int i = 0; i < (int)blacklisted.size(); i++)
+			result = result || (blacklisted[i].find(driverName) != std::string::npos);
+		return result;
+	}
+};
+
+class ASIOAudioIODeviceList {
+private:
+	bool hasScanned = false;
+	ASIODriverRegistry registry{std::make_unique<ASIORegistryDriverSource>()};
+	std::unordered_map<int, ASIOAudioIODevice *> devices; // created devices, by registry index of their class id
+
+public:
+	~ASIOAudioIODeviceList()
+	{
+		// no rescan may run while the devices go away
+		registry.unwatch();
+		for (int i = 0; i < maxNumASIODevices; i++) {
+			if (currentASIODev[i])
+				delete currentASIODev[i];
+		}
+	}
+
+	/* Scans the installed drivers, then keeps rescanning in the background as drivers come and go. */
+	void scanForDevices()
+	{
+		registry.rescan();
+		hasScanned = true;
+		registry.watch();
+	}
+
+	/* names of the drivers currently installed */
+	std::vector<std::string> getDeviceNames() const { return registry.names(); }
+
+	/* Bumped by every rescan which changes the installed drivers; a list of names older than this is stale. */
+	uint64_t getGeneration() const { return registry.generation(); }
+
+	/* Devices live until the list is destroyed, so the slots are taken in creation order and never freed. */
+	int findFreeSlot() const
+	{
+		if ((int)devices.size() < maxNumASIODevices)
+			return (int)devices.size();
 
 		error("You have more than 16 asio devices, that's too many !\nShip me some...");
 		return -1;
 	}
 
+	/* Stable index of a driver, even once removed; -1 if it was never installed. */
 	int getIndexFromDeviceName(const std::string name)
 	{
 		// need to call scanForDevices() before doing this
 		if (!hasScanned || name.size() == 0)
 			return -1;
 
-		for (int i = 0; i < deviceNames.size(); i++) {
-			if (deviceNames[i] == name)
-				return i;
-		}
-		return -1;
+		return registry.indexOf(name);
 	}
 
+	/* Creates the device of an installed driver, or returns it if it already exists. UI thread. */
 	ASIOAudioIODevice *attachDevice(const std::string inputDeviceName)
 	{
 		// need to call scanForDevices() before doing this & to have a driver name !
 		if (inputDeviceName.size() == 0 || !hasScanned)
 			return nullptr;
 
-		std::string deviceName = inputDeviceName;
-		int index = getIndexFromDeviceName(deviceName);
-
-		if (index >= 0) {
-			int freeSlot = findFreeSlot();
+		AsioDriver driver;
+		const int index = registry.indexOf(inputDeviceName);
+		if (!registry.get(index, driver))
+			return nullptr;
+		// a driver renamed or listed twice still has a single device
+		int key = registry.indexOfClsid(driver.clsid);
+		if (key < 0)
+			key = index;
+		auto existing = devices.find(key);
+		if (existing != devices.end())
+			return existing->second;
+		// class ids are plain ascii
+		std::wstring clsid(driver.clsid.begin(), driver.clsid.end());
+		CLSID classId;
+		if (CLSIDFromString((LPOLESTR)clsid.c_str(), &classId) != S_OK)
+			return nullptr;
 
-			if (freeSlot >= 0) {
-				// check if the device has not already been created
-				for (int j = 0; j < maxNumASIODevices; j++) {
-					if (currentASIODev[j]) {
-						if (deviceName == currentASIODev[j]->getName())
-							return currentASIODev[j];
-					}
-				}
-				return new ASIOAudioIODevice(deviceName, classIds[index], freeSlot);
-			}
-		}
-		return nullptr;
+		int freeSlot = findFreeSlot();
+		if (freeSlot < 0)
+			return nullptr;
+		ASIOAudioIODevice *device = new ASIOAudioIODevice(inputDeviceName, classId, freeSlot);
+		devices[key] = device;
+		return device;
 	}
 };
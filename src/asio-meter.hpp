@@ -0,0 +1,207 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Per-channel levels of a device, measured by the ASIO callback right after conversion.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "asio-convert.hpp"
+
+//============================================================================
+/* Peak and RMS of each physical input. The callback measures a period while it is still in the L1 cache, just after
+ * its conversion, so the sources do not need a meter filter each rescanning the same samples.
+ * Only the channels some client reads are converted, hence metered.
+ */
+class ASIOLevelMeter {
+public:
+	/* Only call while the device is stopped; the readers (stats of the sources) may still run. */
+	void reset(int channelCount)
+	{
+		std::lock_guard<std::mutex> lock(readersMutex);
+		if (channelCount != numChannels) {
+			channels.reset(channelCount > 0 ? new Channel[channelCount] : nullptr);
+			numChannels = channelCount > 0 ? channelCount : 0;
+		}
+		for (int i = 0; i < numChannels; i++) {
+			channels[i].peak.store(0.0f, std::memory_order_relaxed);
+			channels[i].rms.store(0.0f, std::memory_order_relaxed);
+			channels[i].metered.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	/* Driver thread: measures n converted samples of a channel. */
+	void measure(int channel, const float *src, int n) noexcept
+	{
+		static const auto kernel = ASIOCpuFeatures::get().avx2 && ASIOCpuFeatures::get().fma ? levelsAVX2
+											       : levelsSSE2;
+		float peak, sumSquares;
+		if (channel >= numChannels || n <= 0)
+			return;
+		kernel(src, n, peak, sumSquares);
+		record(channels[channel], peak, std::sqrt(sumSquares / (float)n));
+	}
+
+	/* Driver thread: records a digitally silent period. */
+	void silence(int channel) noexcept
+	{
+		if (channel < numChannels)
+			record(channels[channel], 0.0f, 0.0f);
+	}
+
+	/* Any thread: peak since the previous read and RMS of the latest period, both linear. Returns false for the
+	 * channels not metered since the device started.
+	 */
+	bool read(int channel, float &peak, float &rms)
+	{
+		std::lock_guard<std::mutex> lock(readersMutex);
+		return readChannel(channel, peak, rms);
+	}
+
+	/* Levels in dBFS of the metered channels, e.g. "1: -6.0/-18.2 | 2: -inf/-inf", counted from 1. */
+	std::string summary()
+	{
+		std::lock_guard<std::mutex> lock(readersMutex);
+		std::string text;
+		char buf[64];
+		float peak, rms;
+
+		for (int i = 0; i < numChannels; i++) {
+			if (!readChannel(i, peak, rms))
+				continue;
+			snprintf(buf, sizeof(buf), "%s%d: %.1f/%.1f", text.empty() ? "" : " | ", i + 1, toDB(peak),
+				 toDB(rms));
+			text += buf;
+		}
+		return text.empty() ? "no metered channel" : text + " dBFS (peak/rms)";
+	}
+
+	/* True if the raw samples of a period are all zero, in which case their conversion can be skipped. */
+	ASIO_TARGET("sse2")
+	static bool isSilent(const void *src, size_t bytes) noexcept
+	{
+		const uint8_t *p = (const uint8_t *)src;
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+
+		for (; i + 64 <= bytes; i += 64) {
+			__m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)),
+						 _mm_loadu_si128((const __m128i *)(p + i + 16)));
+			v = _mm_or_si128(v, _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i + 32)),
+							 _mm_loadu_si128((const __m128i *)(p + i + 48))));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF)
+				return false;
+		}
+		for (; i < bytes; i++)
+			if (p[i])
+				return false;
+		return true;
+	}
+
+private:
+	struct Channel {
+		std::atomic<float> peak{0.0f};
+		std::atomic<float> rms{0.0f};
+		std::atomic<bool> metered{false};
+	};
+	std::unique_ptr<Channel[]> channels;
+	int numChannels = 0;
+	// keeps reset() from freeing the channels under a reader; the driver thread never takes it
+	std::mutex readersMutex;
+
+	bool readChannel(int channel, float &peak, float &rms) noexcept
+	{
+		if (channel >= numChannels || !channels[channel].metered.load(std::memory_order_acquire))
+			return false;
+		peak = channels[channel].peak.exchange(0.0f, std::memory_order_relaxed);
+		rms = channels[channel].rms.load(std::memory_order_relaxed);
+		return true;
+	}
+
+	static void record(Channel &c, float peak, float rms) noexcept
+	{
+		// single writer: a reader resetting the peak concurrently at worst loses one period
+		if (peak > c.peak.load(std::memory_order_relaxed))
+			c.peak.store(peak, std::memory_order_relaxed);
+		c.rms.store(rms, std::memory_order_relaxed);
+		c.metered.store(true, std::memory_order_release);
+	}
+
+	static float toDB(float v) noexcept { return v > 0.0f ? 20.0f * std::log10(v) : -INFINITY; }
+
+	ASIO_TARGET("sse2")
+	static void levelsSSE2(const float *src, int n, float &peak, float &sumSquares) noexcept
+	{
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		__m128 maxv = _mm_setzero_ps(), sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+		int i = 0;
+
+		for (; i + 8 <= n; i += 8) {
+			const __m128 a = _mm_loadu_ps(src + i), b = _mm_loadu_ps(src + i + 4);
+			maxv = _mm_max_ps(maxv, _mm_max_ps(_mm_and_ps(a, absMask), _mm_and_ps(b, absMask)));
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(a, a));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(b, b));
+		}
+		sum0 = _mm_add_ps(sum0, sum1);
+		sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+		sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+		maxv = _mm_max_ps(maxv, _mm_movehl_ps(maxv, maxv));
+		maxv = _mm_max_ss(maxv, _mm_shuffle_ps(maxv, maxv, 1));
+		float m = _mm_cvtss_f32(maxv), s = _mm_cvtss_f32(sum0);
+		for (; i < n; i++) {
+			m = std::fabs(src[i]) > m ? std::fabs(src[i]) : m;
+			s += src[i] * src[i];
+		}
+		peak = m;
+		sumSquares = s;
+	}
+
+	ASIO_TARGET("avx2,fma")
+	static void levelsAVX2(const float *src, int n, float &peak, float &sumSquares) noexcept
+	{
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+		__m256 maxv = _mm256_setzero_ps(), sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+		int i = 0;
+
+		for (; i + 16 <= n; i += 16) {
+			const __m256 a = _mm256_loadu_ps(src + i), b = _mm256_loadu_ps(src + i + 8);
+			maxv = _mm256_max_ps(maxv, _mm256_max_ps(_mm256_and_ps(a, absMask), _mm256_and_ps(b, absMask)));
+			sum0 = _mm256_fmadd_ps(a, a, sum0);
+			sum1 = _mm256_fmadd_ps(b, b, sum1);
+		}
+		sum0 = _mm256_add_ps(sum0, sum1);
+		__m128 s4 = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+		__m128 m4 = _mm_max_ps(_mm256_castps256_ps128(maxv), _mm256_extractf128_ps(maxv, 1));
+		s4 = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+		s4 = _mm_add_ss(s4, _mm_shuffle_ps(s4, s4, 1));
+		m4 = _mm_max_ps(m4, _mm_movehl_ps(m4, m4));
+		m4 = _mm_max_ss(m4, _mm_shuffle_ps(m4, m4, 1));
+		float m = _mm_cvtss_f32(m4), s = _mm_cvtss_f32(s4);
+		for (; i < n; i++) {
+			m = std::fabs(src[i]) > m ? std::fabs(src[i]) : m;
+			s += src[i] * src[i];
+		}
+		peak = m;
+		sumSquares = s;
+	}
+};
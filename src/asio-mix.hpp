@@ -0,0 +1,337 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Optional per-source mix matrix: each obs channel may sum several ASIO inputs with a gain.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "asio-convert.hpp"
+
+/* One non-zero coefficient of a mix matrix. */
+struct ASIOMixTerm {
+	int output;
+	int input;
+	float gain;
+};
+
+//============================================================================
+/* Immutable, sparse target matrix. Outputs with no term keep their plain 1:1 route. */
+struct ASIOMixMatrix {
+	static constexpr int maxOutputs = 8; // MAX_AUDIO_CHANNELS
+
+	std::vector<ASIOMixTerm> terms;
+	bool mixed[maxOutputs] = {};
+	uint32_t generation = 0; // tells the mixer the matrix changed
+
+	/* Parses one line per obs channel, channels counted from 1:
+	 *     <obs channel> = <asio input>[*<gain>] + <asio input>[*<gain>] ...
+	 * Gains are linear, or in dB with a "dB" suffix; lines starting with '#' are comments. e.g.
+	 *     1 = 1 + 2*0.5
+	 *     2 = 3*-6dB
+	 * Returns false and describes the first bad line in error; valid lines are kept either way.
+	 */
+	bool parse(const char *text, int numInputs, std::string &error)
+	{
+		static std::atomic<uint32_t> generations{0};
+		bool ok = true;
+		int lineNumber = 0;
+
+		generation = ++generations;
+		terms.clear();
+		memset(mixed, 0, sizeof(mixed));
+		while (text && *text) {
+			const char *end = strchr(text, '\n');
+			std::string line(text, end ? end - text : strlen(text));
+			text = end ? end + 1 : nullptr;
+			lineNumber++;
+			if (!parseLine(line, numInputs) && ok) {
+				error = "line " + std::to_string(lineNumber) + ": " + line;
+				ok = false;
+			}
+		}
+		return ok;
+	}
+
+private:
+	static void skipSpaces(const char *&p) noexcept
+	{
+		while (*p == ' ' || *p == '\t' || *p == '\r')
+			p++;
+	}
+
+	bool parseLine(const std::string &line, int numInputs)
+	{
+		const char *p = line.c_str();
+		char *next;
+
+		skipSpaces(p);
+		if (!*p || *p == '#')
+			return true;
+		const long output = strtol(p, &next, 10) - 1;
+		p = next;
+		skipSpaces(p);
+		if (output < 0 || output >= maxOutputs || *p++ != '=')
+			return false;
+
+		std::vector<ASIOMixTerm> parsed;
+		for (;;) {
+			skipSpaces(p);
+			const long input = strtol(p, &next, 10) - 1;
+			if (next == p || input < 0 || input >= numInputs)
+				return false;
+			p = next;
+			skipSpaces(p);
+			float gain = 1.0f;
+			if (*p == '*') {
+				p++;
+				gain = strtof(p, &next);
+				if (next == p)
+					return false;
+				p = next;
+				if ((p[0] == 'd' || p[0] == 'D') && (p[1] == 'b' || p[1] == 'B')) {
+					gain = std::pow(10.0f, gain / 20.0f);
+					p += 2;
+				}
+				skipSpaces(p);
+			}
+			parsed.push_back({(int)output, (int)input, gain});
+			if (*p != '+')
+				break;
+			p++;
+		}
+		if (*p)
+			return false;
+		terms.insert(terms.end(), parsed.begin(), parsed.end());
+		mixed[output] = true;
+		return true;
+	}
+};
+
+//============================================================================
+/* Mixing state of one source, owned by the delivery thread. Gain changes are ramped linearly over rampTime
+ * seconds so that editing the matrix does not click.
+ */
+class ASIOMixer {
+public:
+	static constexpr double rampTime = 0.02;
+
+	/* inputs[i] is the converted planar buffer of asio input i, or nullptr if it was not converted; route[n] is the
+	 * input obs channel n plays when it is not mixed. Fills the outputs flagged in the matrix, and those still
+	 * fading back to their route; output(n) then points to obs channel n when mixes(n). A null target fades every
+	 * output back to its route, as bypass() does.
+	 */
+	void process(const ASIOMixMatrix *target, const int *route, const float *const *inputs, int numInputs,
+		     int frames, double sampleRate)
+	{
+		if (!target)
+			bypass(route, sampleRate);
+		else if (target->generation != generation)
+			retarget(*target, route, (int)(sampleRate * rampTime));
+		if ((int)buffer.size() < frames * ASIOMixMatrix::maxOutputs) {
+			buffer.resize((size_t)frames * ASIOMixMatrix::maxOutputs);
+			capacity = frames;
+		}
+
+		bool written[ASIOMixMatrix::maxOutputs] = {};
+		bool fading[ASIOMixMatrix::maxOutputs] = {};
+		for (size_t k = 0; k < state.size(); k++) {
+			State &s = state[k];
+			float *dest = output(s.output);
+			const float *src = s.input < numInputs ? inputs[s.input] : nullptr;
+			if (!written[s.output]) {
+				memset(dest, 0, frames * sizeof(float));
+				written[s.output] = true;
+			}
+			int done = 0;
+			if (s.remaining > 0) {
+				done = s.remaining < frames ? s.remaining : frames;
+				if (src)
+					rampAdd(src, dest, done, s.current, s.step);
+				s.current += s.step * done;
+				s.remaining -= done;
+				if (!s.remaining)
+					s.current = s.target;
+				else
+					fading[s.output] = true;
+			}
+			if (src && s.current != 0.0f)
+				gainAdd(src + done, dest + done, frames - done, s.current);
+		}
+		for (int n = 0; n < ASIOMixMatrix::maxOutputs; n++) {
+			if (mixed[n] && !written[n])
+				memset(output(n), 0, frames * sizeof(float));
+			produced[n] = mixed[n] || written[n];
+		}
+		// drop the terms which finished fading out, and the outputs back to their plain route
+		for (size_t k = 0; k < state.size();) {
+			const State &s = state[k];
+			if (!s.remaining && (s.target == 0.0f || (!mixed[s.output] && !fading[s.output])))
+				state.erase(state.begin() + k);
+			else
+				k++;
+		}
+	}
+
+	float *output(int n) noexcept { return buffer.data() + (size_t)n * capacity; }
+
+	/* Whether the last process() call filled output(n); otherwise obs channel n plays its route. */
+	bool mixes(int n) const noexcept { return produced[n]; }
+
+	/* Whether a matrix is playing or fading out: process() must go on being called, even with no target. */
+	bool active() const noexcept { return generation != 0 || !state.empty(); }
+
+	/* The source goes back to its plain routes: the mixed outputs fade back to their routed input at unity gain. */
+	void bypass(const int *route, double sampleRate)
+	{
+		static const ASIOMixMatrix none;
+		if (generation)
+			retarget(none, route, (int)(sampleRate * rampTime));
+	}
+
+	/* dest[i] += src[i] * gain */
+	static void gainAdd(const float *src, float *dest, int n, float gain) noexcept
+	{
+		static const auto kernel = ASIOCpuFeatures::get().avx2 && ASIOCpuFeatures::get().fma ? gainAddFMA
+											       : gainAddSSE;
+		kernel(src, dest, n, gain);
+	}
+
+	/* dest[i] += src[i] * (gain + i * step) */
+	ASIO_TARGET("sse2")
+	static void rampAdd(const float *src, float *dest, int n, float gain, float step) noexcept
+	{
+		const __m128 steps = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		__m128 g = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(steps, _mm_set1_ps(step)));
+		const __m128 inc = _mm_set1_ps(4.0f * step);
+		int i = 0;
+
+		for (; i + 4 <= n; i += 4) {
+			__m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+			_mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), v));
+			g = _mm_add_ps(g, inc);
+		}
+		for (; i < n; i++)
+			dest[i] += src[i] * (gain + (float)i * step);
+	}
+
+private:
+	struct State {
+		int output;
+		int input;
+		float current;
+		float target;
+		float step;
+		int remaining;
+	};
+
+	std::vector<State> state;
+	std::vector<float> buffer;
+	int capacity = 0;
+	uint32_t generation = 0;
+	bool mixed[ASIOMixMatrix::maxOutputs] = {};    // outputs of the matrix currently playing
+	bool produced[ASIOMixMatrix::maxOutputs] = {}; // outputs filled by the last process() call
+
+	State *find(int output, int input) noexcept
+	{
+		for (State &s : state)
+			if (s.output == output && s.input == input)
+				return &s;
+		return nullptr;
+	}
+
+	bool hasTerms(int output) const noexcept
+	{
+		for (const State &s : state)
+			if (s.output == output)
+				return true;
+		return false;
+	}
+
+	/* Ramps from the gains playing now, whatever the previous target, to those of the new one. */
+	void retarget(const ASIOMixMatrix &target, const int *route, int rampSamples)
+	{
+		if (rampSamples < 1)
+			rampSamples = 1;
+		bool playing[ASIOMixMatrix::maxOutputs];
+		for (int n = 0; n < ASIOMixMatrix::maxOutputs; n++)
+			playing[n] = mixed[n] || hasTerms(n);
+		for (State &s : state)
+			s.target = 0.0f;
+		for (int n = 0; n < ASIOMixMatrix::maxOutputs; n++) {
+			if (route[n] < 0)
+				continue;
+			// an output routed until now played its input at unity gain, its mix starts from there
+			if (target.mixed[n] && !playing[n])
+				state.push_back({n, route[n], 1.0f, 0.0f, 0.0f, 0});
+			// and one leaving the mix ends there, then plays its route again
+			if (!target.mixed[n] && playing[n]) {
+				if (State *s = find(n, route[n]))
+					s->target = 1.0f;
+				else
+					state.push_back({n, route[n], 0.0f, 1.0f, 0.0f, 0});
+			}
+		}
+		for (const ASIOMixTerm &t : target.terms) {
+			if (State *s = find(t.output, t.input))
+				s->target += t.gain;
+			else
+				state.push_back({t.output, t.input, 0.0f, t.gain, 0.0f, 0});
+		}
+		memcpy(mixed, target.mixed, sizeof(mixed));
+		for (State &s : state) {
+			s.remaining = s.current == s.target ? 0 : rampSamples;
+			s.step = (s.target - s.current) / (float)rampSamples;
+		}
+		generation = target.generation;
+	}
+
+	ASIO_TARGET("sse2")
+	static void gainAddSSE(const float *src, float *dest, int n, float gain) noexcept
+	{
+		const __m128 g = _mm_set1_ps(gain);
+		int i = 0;
+
+		for (; i + 4 <= n; i += 4)
+			_mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+		for (; i < n; i++)
+			dest[i] += src[i] * gain;
+	}
+
+	ASIO_TARGET("avx2,fma")
+	static void gainAddFMA(const float *src, float *dest, int n, float gain) noexcept
+	{
+		const __m256 g = _mm256_set1_ps(gain);
+		int i = 0;
+
+		for (; i + 16 <= n; i += 16) {
+			__m256 a = _mm256_fmadd_ps(_mm256_loadu_ps(src + i), g, _mm256_loadu_ps(dest + i));
+			__m256 b = _mm256_fmadd_ps(_mm256_loadu_ps(src + i + 8), g, _mm256_loadu_ps(dest + i + 8));
+			_mm256_storeu_ps(dest + i, a);
+			_mm256_storeu_ps(dest + i + 8, b);
+		}
+		for (; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(dest + i, _mm256_fmadd_ps(_mm256_loadu_ps(src + i), g, _mm256_loadu_ps(dest + i)));
+		for (; i < n; i++)
+			dest[i] += src[i] * gain;
+	}
+};
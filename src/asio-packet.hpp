@@ -0,0 +1,154 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Regroups ASIO periods into packets of a fixed duration before they are handed to obs.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* Planar audio ready for obs; channels[i] is nullptr for the inputs which were not converted. */
+struct ASIOPacket {
+	std::vector<const float *> channels;
+	int frames = 0;
+	uint64_t timestamp = 0;
+};
+
+//============================================================================
+/* Small periods (e.g. 32 frames) are coalesced and large ones (e.g. 2048 frames) split so that obs receives packets
+ * of packetFrames frames whatever the driver buffer size. Timestamps are interpolated from the period timestamps.
+ * Periods already at the packet size, or any period when packetFrames is 0, go through without a copy.
+ * A period which does not follow the pending frames, after a dropped period or a change of rate, first sends them as
+ * a shorter packet so that no packet spans the discontinuity.
+ * Used by the delivery thread only.
+ */
+class ASIOPacketizer {
+public:
+	/* Drops the pending frames; the buffers are allocated here, not while delivering. */
+	void reset(int numChannels, int frames)
+	{
+		channels = numChannels > 0 ? numChannels : 0;
+		packetFrames = frames > 0 ? frames : 0;
+		buffer.assign((size_t)channels * packetFrames, 0.0f);
+		filled.assign(channels, false);
+		block.assign(channels, nullptr);
+		packet.channels.assign(channels, nullptr);
+		pending = 0;
+		flush = false;
+		blockFrames = 0;
+		remaining = 0;
+	}
+
+	int size() const noexcept { return packetFrames; }
+
+	/* Queues a period of numChannels channels; it must stay valid until pop() returns nullptr. */
+	void push(const float *const *inputs, int frames, uint64_t timestamp, double rate) noexcept
+	{
+		const double ns = 1e9 / rate;
+		if (pending) {
+			// the stamps wander by the jitter the clock loop leaves, a lost period moves them by a period
+			const double expected = (double)start + pending * nsPerFrame;
+			flush = ns != nsPerFrame || std::fabs((double)timestamp - expected) > frames * ns / 2.0;
+		}
+		for (int i = 0; i < channels; i++)
+			block[i] = inputs[i];
+		blockFrames = frames;
+		blockTimestamp = timestamp;
+		nsPerFrame = ns;
+		remaining = frames;
+	}
+
+	/* Returns the next complete packet, or nullptr once the queued period is used up; a partial packet is kept
+	 * for the next period. The packet stays valid until the next call.
+	 */
+	const ASIOPacket *pop() noexcept
+	{
+		const int offset = blockFrames - remaining;
+
+		if (flush) {
+			flush = false;
+			return emit(pending);
+		}
+		if (!remaining)
+			return nullptr;
+		if (!packetFrames || (!pending && remaining >= packetFrames)) {
+			const int frames = packetFrames ? packetFrames : remaining;
+			for (int i = 0; i < channels; i++)
+				packet.channels[i] = block[i] ? block[i] + offset : nullptr;
+			packet.frames = frames;
+			packet.timestamp = timeOf(offset);
+			remaining -= frames;
+			return &packet;
+		}
+
+		const int count = remaining < packetFrames - pending ? remaining : packetFrames - pending;
+		if (!pending) {
+			start = timeOf(offset);
+			std::fill(filled.begin(), filled.end(), false);
+		}
+		for (int i = 0; i < channels; i++) {
+			float *dest = buffer.data() + (size_t)i * packetFrames;
+			if (block[i]) {
+				// a channel routed in the middle of a packet starts with silence
+				if (!filled[i])
+					memset(dest, 0, pending * sizeof(float));
+				memcpy(dest + pending, block[i] + offset, count * sizeof(float));
+				filled[i] = true;
+			} else if (filled[i]) {
+				memset(dest + pending, 0, count * sizeof(float));
+			}
+		}
+		pending += count;
+		remaining -= count;
+		if (pending < packetFrames)
+			return nullptr;
+		return emit(packetFrames);
+	}
+
+private:
+	std::vector<float> buffer; // channel n starts at buffer + n * packetFrames
+	std::vector<char> filled;  // channels of buffer holding data
+	int channels = 0;
+	int packetFrames = 0;
+	int pending = 0;    // frames already in buffer
+	uint64_t start = 0; // timestamp of the first pending frame
+	ASIOPacket packet;
+
+	std::vector<const float *> block; // queued period
+	int blockFrames = 0;
+	uint64_t blockTimestamp = 0;
+	int remaining = 0; // frames of the queued period not packed yet
+	double nsPerFrame = 0.0;
+
+	bool flush = false; // the pending frames go out before the queued period
+
+	uint64_t timeOf(int offset) const noexcept { return blockTimestamp + (uint64_t)(offset * nsPerFrame + 0.5); }
+
+	const ASIOPacket *emit(int frames) noexcept
+	{
+		for (int i = 0; i < channels; i++)
+			packet.channels[i] = filled[i] ? buffer.data() + (size_t)i * packetFrames : nullptr;
+		packet.frames = frames;
+		packet.timestamp = start;
+		pending = 0;
+		return &packet;
+	}
+};
@@ -0,0 +1,222 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Index of the installed ASIO drivers, kept up to date while obs runs.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/* An installed driver: its description and its class id as written in the registry, e.g. "{8C5E...}". */
+struct AsioDriver {
+	std::string name;
+	std::string clsid;
+};
+
+//============================================================================
+/* Where the installed drivers are listed: HKLM\SOFTWARE\ASIO on Windows, or any other list, e.g. a fake one when
+ * testing the registry below. Used by one thread at a time, except for cancel().
+ */
+class ASIODriverSource {
+public:
+	virtual ~ASIODriverSource() = default;
+
+	/* Lists the installed drivers; returns false if the list could not be read. */
+	virtual bool enumerate(std::vector<AsioDriver> &drivers) = 0;
+
+	/* Blocks until the list may have changed. Returns false once cancel() was called, or if changes cannot be
+	 * watched.
+	 */
+	virtual bool waitForChange() = 0;
+
+	/* Any thread: makes waitForChange() return false. */
+	virtual void cancel() = 0;
+};
+
+//============================================================================
+/* Drivers found so far, indexed by name and by class id. Indices are stable: a driver which disappears, e.g. an
+ * unplugged USB interface, keeps its index flagged absent and gets it back when it reappears. Every rescan which
+ * changes the list bumps the generation, so that a caller can tell a stale view from a current one.
+ * Thread safe. Once watch() is called a thread rescans whenever the source reports a change.
+ */
+class ASIODriverRegistry {
+public:
+	explicit ASIODriverRegistry(std::unique_ptr<ASIODriverSource> driverSource) : source(std::move(driverSource))
+	{
+	}
+	ASIODriverRegistry(const ASIODriverRegistry &) = delete;
+	ASIODriverRegistry &operator=(const ASIODriverRegistry &) = delete;
+	~ASIODriverRegistry() { unwatch(); }
+
+	/* Reads the source again; returns true if a driver appeared, disappeared or changed its class id. */
+	bool rescan()
+	{
+		std::lock_guard<std::mutex> scanLock(scanMutex);
+		std::vector<AsioDriver> found;
+		if (!source->enumerate(found))
+			return false;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint64_t next = currentGeneration + 1;
+		std::vector<char> seen(entries.size(), false);
+		bool changed = false;
+
+		for (const AsioDriver &driver : found) {
+			auto it = byName.find(driver.name);
+			if (it == byName.end()) {
+				const int index = (int)entries.size();
+				entries.push_back({driver, true, next});
+				seen.push_back(true);
+				byName[driver.name] = index;
+				byClsid.emplace(clsidKey(driver.clsid), index);
+				changed = true;
+				continue;
+			}
+			// with several drivers of the same name, the first one wins
+			const int index = it->second;
+			if (seen[index])
+				continue;
+			seen[index] = true;
+			Entry &entry = entries[index];
+			if (entry.present && entry.driver.clsid == driver.clsid)
+				continue;
+			if (entry.driver.clsid != driver.clsid) {
+				auto owner = byClsid.find(clsidKey(entry.driver.clsid));
+				if (owner != byClsid.end() && owner->second == index)
+					byClsid.erase(owner);
+				byClsid.emplace(clsidKey(driver.clsid), index);
+			}
+			entry.driver = driver;
+			entry.present = true;
+			entry.generation = next;
+			changed = true;
+		}
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (!seen[i] && entries[i].present) {
+				entries[i].present = false;
+				entries[i].generation = next;
+				changed = true;
+			}
+		}
+		if (changed)
+			currentGeneration = next;
+		return changed;
+	}
+
+	/* Starts rescanning in the background on every change reported by the source. */
+	void watch()
+	{
+		if (watcher.joinable())
+			return;
+		watcher = std::thread([this]() {
+			while (source->waitForChange())
+				rescan();
+		});
+	}
+
+	void unwatch()
+	{
+		if (!watcher.joinable())
+			return;
+		source->cancel();
+		watcher.join();
+	}
+
+	/* Number of rescans which changed the list; 0 before the first scan. */
+	uint64_t generation() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return currentGeneration;
+	}
+
+	/* Index of a driver, present or not; -1 if it was never seen. */
+	int indexOf(const std::string &name) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = byName.find(name);
+		return it == byName.end() ? -1 : it->second;
+	}
+
+	/* Index of the first driver seen with a class id in any letter case, present or not; -1 if none. A driver
+	 * renamed in the registry, or listed under two names, keeps the index it had under its first name.
+	 */
+	int indexOfClsid(const std::string &clsid) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = byClsid.find(clsidKey(clsid));
+		return it == byClsid.end() ? -1 : it->second;
+	}
+
+	/* Copies the driver at index; returns false if the index is unknown or the driver is absent. */
+	bool get(int index, AsioDriver &driver) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (index < 0 || index >= (int)entries.size() || !entries[index].present)
+			return false;
+		driver = entries[index].driver;
+		return true;
+	}
+
+	/* Class ids in one letter case, to compare them or key a map. */
+	static std::string clsidKey(std::string clsid)
+	{
+		for (char &c : clsid)
+			c = (char)toupper((unsigned char)c);
+		return clsid;
+	}
+
+	/* Generation of the rescan which last changed the driver at index, 0 if unknown. */
+	uint64_t generationOf(int index) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return index >= 0 && index < (int)entries.size() ? entries[index].generation : 0;
+	}
+
+	/* Names of the present drivers, in index order. */
+	std::vector<std::string> names() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::string> list;
+		for (const Entry &entry : entries)
+			if (entry.present)
+				list.push_back(entry.driver.name);
+		return list;
+	}
+
+private:
+	struct Entry {
+		AsioDriver driver;
+		bool present;
+		uint64_t generation; // rescan which last changed the entry
+	};
+
+	std::unique_ptr<ASIODriverSource> source;
+	std::mutex scanMutex;     // one enumeration of the source at a time
+	mutable std::mutex mutex; // guards the entries and indices
+	std::vector<Entry> entries;
+	std::unordered_map<std::string, int> byName;
+	std::unordered_map<std::string, int> byClsid;
+	uint64_t currentGeneration = 0;
+	std::thread watcher;
+};
@@ -0,0 +1,189 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Polyphase sample rate conversion shared by all the sources of a device.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "asio-convert.hpp"
+
+//============================================================================
+/* Kaiser windowed sinc low-pass split in upFactor phases, for a rational ratio outRate / inRate = up / down.
+ * The filter keeps about 90 dB of stop band attenuation with a pass band up to 90% of the lower Nyquist frequency.
+ * Phases are stored oldest tap first and padded to a multiple of 8 taps for the simd dot products.
+ */
+class ASIOResampleFilter {
+public:
+	static constexpr int maxUpFactor = 1024;
+
+	ASIOResampleFilter(int inRate, int outRate) : inRate(inRate), outRate(outRate)
+	{
+		const int g = gcd(inRate, outRate);
+		up = outRate / g;
+		down = inRate / g;
+		if (up > maxUpFactor)
+			return;
+
+		// bandwidths relative to the input rate
+		const double ratio = up < down ? (double)up / down : 1.0;
+		const double cutoff = 0.5 * ratio * 0.95;
+		const double transition = 0.5 * ratio * 0.1;
+		const double attenuation = 90.0;
+		const double beta = 0.1102 * (attenuation - 8.7);
+		taps = (int)std::ceil((attenuation - 8.0) / (2.285 * 2.0 * pi * transition));
+		taps = (taps + 7) & ~7;
+
+		const int length = taps * up;
+		const double center = (length - 1) / 2.0;
+		const double i0beta = besselI0(beta);
+		coeffs.assign((size_t)length, 0.0f);
+		for (int p = 0; p < up; p++) {
+			for (int j = 0; j < taps; j++) {
+				// tap j of phase p is prototype sample p + j * up, applied to the j-th newest input
+				const double n = p + (double)j * up - center;
+				const double x = n / up; // in input samples
+				const double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * x) / (pi * x);
+				const double r = 2.0 * (p + (double)j * up) / (length - 1) - 1.0;
+				const double w = besselI0(beta * std::sqrt(std::fmax(0.0, 1.0 - r * r))) / i0beta;
+				coeffs[(size_t)p * taps + (taps - 1 - j)] = (float)(sinc * w);
+			}
+		}
+	}
+
+	bool valid() const noexcept { return up <= maxUpFactor; }
+	const float *phase(int p) const noexcept { return &coeffs[(size_t)p * taps]; }
+
+	/* upper bound of the frames produced from numFrames input frames */
+	int maxOutput(int numFrames) const noexcept { return (int)(((long long)numFrames * up + down - 1) / down) + 1; }
+
+	const int inRate, outRate;
+	int up = 1, down = 1;
+	int taps = 0;
+
+private:
+	static constexpr double pi = 3.14159265358979323846;
+	std::vector<float> coeffs;
+
+	static int gcd(int a, int b) noexcept
+	{
+		while (b) {
+			const int t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+	static double besselI0(double x) noexcept
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 64 && term > 1e-12 * sum; k++) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+};
+
+//============================================================================
+/* Per-channel state; all the resamplers of a device advance in lock step so their outputs stay aligned. */
+class ASIOResampler {
+public:
+	ASIOResampler(std::shared_ptr<const ASIOResampleFilter> f, int maxFrames)
+		: filter(std::move(f)),
+		  history((size_t)filter->taps - 1 + maxFrames, 0.0f)
+	{
+		static const auto kernel = ASIOCpuFeatures::get().avx2 && ASIOCpuFeatures::get().fma ? dotFMA : dotSSE;
+		dot = kernel;
+	}
+
+	/* Converts numFrames input frames (at most maxFrames); returns the number of frames written to dest. */
+	int process(const float *src, int numFrames, float *dest) noexcept
+	{
+		const int keep = filter->taps - 1;
+		float *h = history.data();
+		memcpy(h + keep, src, numFrames * sizeof(float));
+
+		int produced = 0;
+		while (next < numFrames) {
+			dest[produced++] = dot(h + next, filter->phase(phase), filter->taps);
+			advance();
+		}
+		next -= numFrames;
+		memmove(h, h + numFrames, keep * sizeof(float));
+		return produced;
+	}
+
+	/* Advances like process() would, for a channel nobody listens to; its history restarts from silence. */
+	int skip(int numFrames) noexcept
+	{
+		// the same steps as advance(), counted at once: in 1/up input frames, each output moves down further
+		const long long up = filter->up, down = filter->down;
+		long long position = next * up + phase;
+		const long long end = numFrames * up;
+		const int produced = position < end ? (int)((end - position + down - 1) / down) : 0;
+		position += produced * down;
+		next = (int)(position / up) - numFrames;
+		phase = (int)(position % up);
+		memset(history.data(), 0, (filter->taps - 1) * sizeof(float));
+		return produced;
+	}
+
+private:
+	std::shared_ptr<const ASIOResampleFilter> filter;
+	std::vector<float> history; // taps - 1 past frames followed by the current block
+	int next = 0;               // index in the current block of the newest frame of the next output
+	int phase = 0;
+	float (*dot)(const float *, const float *, int) noexcept;
+
+	inline void advance() noexcept
+	{
+		phase += filter->down;
+		next += phase / filter->up;
+		phase %= filter->up;
+	}
+
+	ASIO_TARGET("sse2")
+	static float dotSSE(const float *a, const float *b, int n) noexcept
+	{
+		__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+		for (int i = 0; i < n; i += 8) {
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		}
+		acc0 = _mm_add_ps(acc0, acc1);
+		acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+		acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+		return _mm_cvtss_f32(acc0);
+	}
+
+	ASIO_TARGET("avx2,fma")
+	static float dotFMA(const float *a, const float *b, int n) noexcept
+	{
+		__m256 acc = _mm256_setzero_ps();
+		for (int i = 0; i < n; i += 8)
+			acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+};
@@ -0,0 +1,221 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Lock-free structures shared by the ASIO callback, the delivery thread and the UI thread.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//============================================================================
+/* Set of channels of a device, one bit each. It is sized when the device opens; nothing else allocates, so the
+ * driver thread can use it.
+ */
+class ASIOChannelMask {
+public:
+	void resize(int numChannels) { words.assign(((size_t)numChannels + 63) / 64, 0); }
+
+	void clear() noexcept { std::fill(words.begin(), words.end(), 0); }
+
+	bool test(int index) const noexcept
+	{
+		const size_t w = (size_t)index >> 6;
+		return w < words.size() && ((words[w] >> (index & 63)) & 1);
+	}
+
+	void set(int index) noexcept
+	{
+		const size_t w = (size_t)index >> 6;
+		if (w < words.size())
+			words[w] |= 1ull << (index & 63);
+	}
+
+	/* Copies other, truncated or zero extended to the size of this mask. */
+	void assign(const ASIOChannelMask &other) noexcept
+	{
+		for (size_t w = 0; w < words.size(); w++)
+			words[w] = w < other.words.size() ? other.words[w] : 0;
+	}
+
+	/* Removes the channels set in other. */
+	void remove(const ASIOChannelMask &other) noexcept
+	{
+		for (size_t w = 0; w < words.size() && w < other.words.size(); w++)
+			words[w] &= ~other.words[w];
+	}
+
+	/* Calls f(index) for each channel of the set, in increasing order. */
+	template<class F> void forEach(F &&f) const
+	{
+		for (size_t w = 0; w < words.size(); w++) {
+			uint64_t bits = words[w];
+			while (bits) {
+				f((int)(w * 64) + lowestBit(bits));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+private:
+	std::vector<uint64_t> words;
+
+	static int lowestBit(uint64_t bits) noexcept
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return (int)index;
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
+};
+
+/* One device period of planar float audio. Only the channels set in routed hold data; the ones set in silent were
+ * asked for but digitally silent, so not converted.
+ */
+struct ASIOAudioBlock {
+	float *data = nullptr; // channel n starts at data + n * maxFrames
+	int frames = 0;
+	ASIOChannelMask routed;
+	ASIOChannelMask silent;
+	uint64_t timestamp = 0;
+};
+
+//============================================================================
+/* Single producer (driver thread), single consumer (delivery thread) ring of preallocated blocks.
+ * Neither side ever blocks or allocates; when the consumer falls behind the producer has to drop the period.
+ */
+class ASIOBlockRing {
+public:
+	/* Not thread safe: only call while neither side is running. numSlots is rounded up to a power of two. */
+	void resize(int numSlots, int numChannels, int maxFrames)
+	{
+		int n = 1;
+		while (n < numSlots)
+			n <<= 1;
+		frames = maxFrames;
+		storage.assign((size_t)n * numChannels * maxFrames, 0.0f);
+		blocks.assign(n, ASIOAudioBlock());
+		for (int i = 0; i < n; i++) {
+			blocks[i].data = storage.data() + (size_t)i * numChannels * maxFrames;
+			blocks[i].routed.resize(numChannels);
+			blocks[i].silent.resize(numChannels);
+		}
+		mask = (uint32_t)n - 1;
+		head = 0;
+		tail = 0;
+	}
+
+	float *channel(const ASIOAudioBlock &block, int index) const noexcept
+	{
+		return block.data + (size_t)index * frames;
+	}
+
+	int maxFrames() const noexcept { return frames; }
+
+	/* Producer side. Returns nullptr if every slot is still waiting to be delivered. */
+	ASIOAudioBlock *beginWrite() noexcept
+	{
+		const uint32_t h = head.load(std::memory_order_relaxed);
+		if (blocks.empty() || h - tail.load(std::memory_order_acquire) > mask)
+			return nullptr;
+		return &blocks[h & mask];
+	}
+
+	void endWrite() noexcept { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	/* Producer side: true once the consumer is done with every block written. */
+	bool drained() const noexcept
+	{
+		return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+	}
+
+	/* Consumer side. Returns nullptr when the ring is empty. */
+	ASIOAudioBlock *beginRead() noexcept
+	{
+		const uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return nullptr;
+		return &blocks[t & mask];
+	}
+
+	void endRead() noexcept { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+	std::vector<float> storage;
+	std::vector<ASIOAudioBlock> blocks;
+	int frames = 0;
+	uint32_t mask = 0;
+	alignas(64) std::atomic<uint32_t> head{0}; // written by the producer only
+	alignas(64) std::atomic<uint32_t> tail{0}; // written by the consumer only
+};
+
+//============================================================================
+/* Pointer to an immutable object which writers replace as a whole (read-copy-update).
+ * Readers never block: they register in the current epoch, use the object and leave. A writer swaps the pointer,
+ * flips the epoch and waits for the readers of the previous epoch to leave before deleting the old object.
+ */
+template<class T> class ASIOSnapshotPtr {
+public:
+	explicit ASIOSnapshotPtr(T *initial) : current(initial) {}
+	~ASIOSnapshotPtr() { delete current.load(); }
+
+	ASIOSnapshotPtr(const ASIOSnapshotPtr &) = delete;
+	ASIOSnapshotPtr &operator=(const ASIOSnapshotPtr &) = delete;
+
+	/* Reader side; returns the epoch to hand back to leave(). */
+	int enter() noexcept
+	{
+		for (;;) {
+			const int e = epoch.load();
+			readers[e].fetch_add(1);
+			// a writer may have flipped the epoch between the two lines; it would not wait for us then
+			if (epoch.load() == e)
+				return e;
+			readers[e].fetch_sub(1);
+		}
+	}
+
+	const T *get() const noexcept { return current.load(); }
+
+	void leave(int e) noexcept { readers[e].fetch_sub(1); }
+
+	/* Writer side; writers must be serialized by the caller, who may read get() without entering. */
+	void publish(T *next)
+	{
+		T *old = current.exchange(next);
+		const int e = epoch.load();
+		epoch.store(e ^ 1);
+		while (readers[e].load() != 0)
+			std::this_thread::yield();
+		delete old;
+	}
+
+private:
+	std::atomic<T *> current;
+	std::atomic<int> epoch{0};
+	alignas(64) std::atomic<int> readers[2] = {};
+};
@@ -0,0 +1,169 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Lock-free timing statistics of the ASIO callback.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+//============================================================================
+/* Histogram of durations in microseconds with 4 buckets per octave (at most 19% relative error), up to 16 s.
+ * One thread records, any thread may read; counts are relaxed atomics so a reader sees a slightly torn but
+ * consistent enough picture.
+ */
+class ASIOHistogram {
+public:
+	static constexpr int numBuckets = 96;
+
+	void record(uint64_t ns) noexcept
+	{
+		const uint64_t us = ns / 1000;
+		buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+		if (us > maxUs.load(std::memory_order_relaxed))
+			maxUs.store(us, std::memory_order_relaxed);
+	}
+
+	/* Upper bound, in microseconds, of the bucket holding the given fraction (0..1) of the samples, capped by the
+	 * largest value recorded.
+	 */
+	uint64_t percentile(double fraction) const noexcept
+	{
+		uint64_t total = 0;
+		for (const auto &b : buckets)
+			total += b.load(std::memory_order_relaxed);
+		if (!total)
+			return 0;
+		const uint64_t rank = (uint64_t)(fraction * (double)(total - 1)) + 1;
+		const uint64_t top = maxUs.load(std::memory_order_relaxed);
+		uint64_t seen = 0;
+		for (int i = 0; i + 1 < numBuckets; i++) {
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+				return lowerBound(i + 1) < top ? lowerBound(i + 1) : top;
+		}
+		return top;
+	}
+
+	uint64_t maximum() const noexcept { return maxUs.load(std::memory_order_relaxed); }
+
+	void reset() noexcept
+	{
+		for (auto &b : buckets)
+			b.store(0, std::memory_order_relaxed);
+		maxUs.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> buckets[numBuckets] = {};
+	std::atomic<uint64_t> maxUs{0};
+
+	static int bucketOf(uint64_t us) noexcept
+	{
+		if (us < 4)
+			return (int)us;
+		int e = 63;
+		while (!(us >> e))
+			e--;
+		const int index = 4 * (e - 1) + (int)((us >> (e - 2)) & 3);
+		return index < numBuckets ? index : numBuckets - 1;
+	}
+
+	static uint64_t lowerBound(int index) noexcept
+	{
+		if (index < 4)
+			return (uint64_t)index;
+		const int e = index / 4 + 1;
+		return (uint64_t)(4 + index % 4) << (e - 2);
+	}
+};
+
+//============================================================================
+/* Health of one device: written by the driver and delivery threads, read by the log and the proc handler. */
+struct ASIODeviceStats {
+	ASIOHistogram processTime; // time spent in processBuffer
+	ASIOHistogram interval;    // time between two callbacks
+	std::atomic<uint64_t> callbacks{0};
+	std::atomic<uint64_t> over50{0}, over80{0}, over100{0}; // callbacks using more than x% of the period
+	std::atomic<uint64_t> xruns{0};                         // kAsioOverload messages
+	std::atomic<uint64_t> droppedPeriods{0};                // periods lost because delivery fell behind
+	// driver requested reopens and the audio each one cost; unlike the above, kept when the device is reopened
+	ASIOHistogram reopenGap;
+	std::atomic<uint64_t> reopens{0};
+
+	/* Records one callback; budget is the duration of the period. */
+	void recordCallback(uint64_t start, uint64_t end, uint64_t previousStart, uint64_t budget) noexcept
+	{
+		const uint64_t spent = end - start;
+		processTime.record(spent);
+		if (previousStart)
+			interval.record(start - previousStart);
+		callbacks.fetch_add(1, std::memory_order_relaxed);
+		if (spent * 2 > budget)
+			over50.fetch_add(1, std::memory_order_relaxed);
+		if (spent * 10 > budget * 8)
+			over80.fetch_add(1, std::memory_order_relaxed);
+		if (spent > budget)
+			over100.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/* Records the time between the last period before a reopen and the first one after it. */
+	void recordReopen(uint64_t gap) noexcept
+	{
+		reopenGap.record(gap);
+		reopens.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void reset() noexcept
+	{
+		processTime.reset();
+		interval.reset();
+		callbacks = 0;
+		over50 = 0;
+		over80 = 0;
+		over100 = 0;
+		xruns = 0;
+		droppedPeriods = 0;
+	}
+
+	/* One line summary, e.g. for the log. */
+	std::string summary() const
+	{
+		char buf[512];
+		snprintf(buf, sizeof(buf),
+			 "%llu callbacks | process p50 %llu us, p99 %llu us, max %llu us | interval p50 %llu us, "
+			 "p99 %llu us, max %llu us | over budget 50%%: %llu, 80%%: %llu, 100%%: %llu | xruns %llu | "
+			 "dropped periods %llu",
+			 (unsigned long long)callbacks.load(), (unsigned long long)processTime.percentile(0.5),
+			 (unsigned long long)processTime.percentile(0.99), (unsigned long long)processTime.maximum(),
+			 (unsigned long long)interval.percentile(0.5), (unsigned long long)interval.percentile(0.99),
+			 (unsigned long long)interval.maximum(), (unsigned long long)over50.load(),
+			 (unsigned long long)over80.load(), (unsigned long long)over100.load(),
+			 (unsigned long long)xruns.load(), (unsigned long long)droppedPeriods.load());
+		std::string text = buf;
+		if (reopens.load(std::memory_order_relaxed)) {
+			snprintf(buf, sizeof(buf), " | reopens %llu, gap p50 %.1f ms, max %.1f ms",
+				 (unsigned long long)reopens.load(), reopenGap.percentile(0.5) / 1000.0,
+				 reopenGap.maximum() / 1000.0);
+			text += buf;
+		}
+		return text;
+	}
+};
@@ -0,0 +1,102 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Timestamps for ASIO periods, derived from the driver sample position.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//============================================================================
+/* Second order delay-locked loop mapping the driver sample position to the obs clock.
+ * The time at which the callback runs is noisy (thread wake-up latency) but the sample position is exact, so the loop
+ * predicts the time of each period from the previous one and the estimated clock rate, then corrects both by a small
+ * fraction of the error. The resulting timestamps are monotonic and follow the device clock drift.
+ */
+class ASIOClockDLL {
+public:
+	/* bandwidth in Hz: lower is smoother but slower to follow a change of clock rate */
+	explicit ASIOClockDLL(double bandwidth = 1.0) : bandwidth(bandwidth) {}
+
+	/* blockSize is the period of the driver in frames, 0 if unknown */
+	void reset(double rate, int blockSize = 0) noexcept
+	{
+		sampleRate = rate;
+		periodFrames = blockSize;
+		locked = false;
+	}
+
+	/* position is the sample position of the period, now the obs time (ns) at which its callback runs.
+	 * Returns the smoothed timestamp of the period.
+	 */
+	uint64_t update(int64_t position, uint64_t now) noexcept
+	{
+		const int64_t delta = position - lastPosition;
+		// (re)lock on the first period and whenever the position jumps, e.g. after a driver resync
+		if (!locked || delta <= 0 || delta > maxStep) {
+			relock(position, now);
+			return lastTime;
+		}
+
+		const double predicted = time + (double)delta * nsPerSample;
+		const double err = (double)(int64_t)(now - (uint64_t)predicted);
+		if (std::fabs(err) > (double)maxStep * nsPerSample) {
+			relock(position, now);
+			return lastTime;
+		}
+
+		const double omega = 2.0 * 3.14159265358979323846 * bandwidth * (double)delta / sampleRate;
+		time = predicted + std::sqrt(2.0) * omega * err;
+		nsPerSample += omega * omega * err / (double)delta;
+		lastPosition = position;
+
+		uint64_t ts = (uint64_t)time;
+		if (ts <= lastTime)
+			ts = lastTime + 1;
+		lastTime = ts;
+		return ts;
+	}
+
+	/* estimated device rate measured against the obs clock */
+	double measuredRate() const noexcept { return locked ? 1e9 / nsPerSample : sampleRate; }
+
+private:
+	const double bandwidth;
+	double sampleRate = 48000.0;
+	int periodFrames = 0;
+	bool locked = false;
+	double time = 0.0;
+	double nsPerSample = 0.0;
+	int64_t lastPosition = 0;
+	uint64_t lastTime = 0;
+	// positions moving by more than this, or callbacks that far off, are treated as a discontinuity
+	int64_t maxStep = 0;
+
+	void relock(int64_t position, uint64_t now) noexcept
+	{
+		locked = true;
+		nsPerSample = 1e9 / sampleRate;
+		// a few periods, and no less than 100 ms so that the wake-up latency of short periods does not count
+		maxStep = std::max((int64_t)(sampleRate / 10.0), (int64_t)periodFrames * 4);
+		time = (double)now;
+		lastPosition = position;
+		if (now > lastTime)
+			lastTime = now;
+	}
+};
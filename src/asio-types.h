@@ -0,0 +1,59 @@
+/* openASIO SDK v2
+ * asio-types.h
+ *
+ * ASIO sample types, split from asio-wrapper.hpp so that they can be used without windows or COM headers.
+ *
+ * Copyright (c) 2023   pkv <pkv.stream@gmail.com> Andersama <anderson.john.alexander@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ *
+ * See asio-wrapper.hpp for the disclaimers and the list of sources.
+ */
+#pragma once
+
+/* from https://app.assembla.com/spaces/portaudio/git/source/master/src/hostapi/asio/pa_asio.cpp#ln345
+ * and ln405
+ * enum order also: https://github.com/SjB/NAudio/blob/master/NAudio/Wave/Asio/ASIOStructures.cs#ln72
+ * lot of details also here
+ * https://github.com/WeAreROLI/JUCE/blob/master/modules/juce_audio_devices/native/juce_win32_ASIO.cpp#ln80
+ * LSB types are little endian, MSB are big endian quite likely, we haven't found them used in the
+ * hosts/drivers we studied.
+ */
+typedef long ASIOSampleType;
+enum {
+	ASIOSTInt16MSB = 0,
+	ASIOSTInt24MSB = 1,
+	ASIOSTInt32MSB = 2,
+	ASIOSTFloat32MSB = 3,
+	ASIOSTFloat64MSB = 4,
+	ASIOSTInt32MSB16 = 8,
+	ASIOSTInt32MSB18 = 9,
+	ASIOSTInt32MSB20 = 10,
+	ASIOSTInt32MSB24 = 11,
+	ASIOSTInt16LSB = 16,
+	ASIOSTInt24LSB = 17,
+	ASIOSTInt32LSB = 18,
+	ASIOSTFloat32LSB = 19,
+	ASIOSTFloat64LSB = 20,
+	ASIOSTInt32LSB16 = 24,
+	ASIOSTInt32LSB18 = 25,
+	ASIOSTInt32LSB20 = 26,
+	ASIOSTInt32LSB24 = 27,
+	ASIOSTDSDInt8LSB1 = 32,
+	ASIOSTDSDInt8MSB1 = 33,
+	ASIOSTDSDInt8NER8 = 40,
+	ASIOSTLastEntry = 41, // from http://lakeofsoft.com/vc/doc/unaASIOAPI.html#ASIOSTLastEntry
+};
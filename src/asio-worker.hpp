@@ -0,0 +1,280 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Thread owning an ASIO driver: the driver is opened, closed and reopened there, never on an obs thread.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* Lifecycle of a device as shown to its sources. */
+enum class ASIODeviceState {
+	closed,
+	closing, // a close is queued; it is skipped if a source attaches again before it runs
+	opening, // the worker is opening the driver or waiting for its first callback
+	running,
+	failed,
+};
+
+//============================================================================
+/* What the worker does with the driver. Everything but openQueued() runs on the worker thread. */
+class ASIOWorkerDriver {
+public:
+	virtual ~ASIOWorkerDriver() = default;
+
+	/* first and last thing the worker thread does, e.g. setting up COM and releasing the driver */
+	virtual void workerStarted() {}
+	virtual void workerStopping() {}
+
+	/* Caller's thread, with the worker lock held: a new open was queued. */
+	virtual void openQueued() {}
+
+	/* Returns the error, empty on success. sampleRate and bufferSize may be 0 for the driver defaults. */
+	virtual std::string openDriver(double sampleRate, int bufferSize) = 0;
+	virtual void closeDriver() = 0;
+	virtual bool driverOpen() = 0;
+	/* reopens an open driver with its current settings, after the driver asked for it; returns the error */
+	virtual std::string reopenDriver() = 0;
+	/* sources attached to the device; a queued close finding some is skipped */
+	virtual int attachedClients() = 0;
+};
+
+//============================================================================
+/* Runs the tasks posted to it in order, and the reopen asked by the driver once it has been quiet for a while.
+ * Opening and closing return at once; the state tells the sources where the device is. On Windows the thread pumps
+ * its messages while idle: it is the apartment of the driver, which may own windows there.
+ */
+class ASIODeviceWorker {
+public:
+	explicit ASIODeviceWorker(ASIOWorkerDriver &owner) : driver(owner) {}
+	~ASIODeviceWorker() { stop(); }
+
+	ASIODeviceWorker(const ASIODeviceWorker &) = delete;
+	ASIODeviceWorker &operator=(const ASIODeviceWorker &) = delete;
+
+	void start()
+	{
+#ifdef _WIN32
+		wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+#endif
+		thread = std::thread([this]() { run(); });
+	}
+
+	/* Runs the tasks already posted, then workerStopping(). */
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake();
+		if (thread.joinable())
+			thread.join();
+#ifdef _WIN32
+		if (wakeEvent)
+			CloseHandle(wakeEvent);
+		wakeEvent = nullptr;
+#endif
+	}
+
+	template<class F> auto post(F &&task) -> std::future<decltype(task())>
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return postLocked(std::forward<F>(task));
+	}
+
+	/* The future holds the error, empty on success; done, if set, is called with it on the worker thread.
+	 * Opening an opening or running device returns the pending result.
+	 */
+	std::shared_future<std::string> openAsync(double sampleRate, int bufferSize,
+						  std::function<void(const std::string &)> done = nullptr)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pendingOpen.valid() && (state == ASIODeviceState::opening || state == ASIODeviceState::running))
+			return pendingOpen;
+		const uint64_t ticket = ++requests;
+		state = ASIODeviceState::opening;
+		driver.openQueued();
+		pendingOpen = postLocked([this, sampleRate, bufferSize, done, ticket]() {
+				      const std::string err = driver.openDriver(sampleRate, bufferSize);
+				      settle(ticket, err.empty() ? ASIODeviceState::running : ASIODeviceState::failed);
+				      if (done)
+					      done(err);
+				      return err;
+			      }).share();
+		return pendingOpen;
+	}
+
+	std::future<void> closeAsync()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint64_t ticket = ++requests;
+		state = ASIODeviceState::closing;
+		// an open asked for from now on runs after this close, instead of returning the previous result
+		pendingOpen = std::shared_future<std::string>();
+		return postLocked([this, ticket]() {
+			// a source attached since the close was asked for, its open is queued behind
+			if (driver.attachedClients() > 0)
+				return;
+			driver.closeDriver();
+			settle(ticket, ASIODeviceState::closed);
+		});
+	}
+
+	ASIODeviceState getState() const { return state; }
+
+	/* Any thread: (re)starts the countdown to a reopen, so that a burst of requests ends in a single one. */
+	void scheduleReset(std::chrono::milliseconds delay)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			resetPending = true;
+			resetDue = std::chrono::steady_clock::now() + delay;
+		}
+		wake();
+	}
+
+	/* The device is being closed or reopened anyway. */
+	void cancelReset()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		resetPending = false;
+	}
+
+private:
+	ASIOWorkerDriver &driver;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+#ifdef _WIN32
+	HANDLE wakeEvent = nullptr;
+#endif
+	std::deque<std::function<void()>> tasks;
+	bool stopping = false;
+	bool resetPending = false; // a reopen is due at resetDue
+	std::chrono::steady_clock::time_point resetDue;
+	std::atomic<ASIODeviceState> state{ASIODeviceState::closed};
+	std::shared_future<std::string> pendingOpen;
+	uint64_t requests = 0; // opens and closes asked for; only the outcome of the latest one sets the state
+
+	/* Callers hold mutex. */
+	template<class F> auto postLocked(F &&task) -> std::future<decltype(task())>
+	{
+		auto job = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<F>(task));
+		tasks.emplace_back([job]() { (*job)(); });
+		wake();
+		return job->get_future();
+	}
+
+	void settle(uint64_t ticket, ASIODeviceState outcome)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ticket == requests)
+			state = outcome;
+	}
+
+	void wake()
+	{
+		cond.notify_one();
+#ifdef _WIN32
+		SetEvent(wakeEvent);
+#endif
+	}
+
+	/* Callers hold mutex, through lock. Returns once woken up or at the deadline, if any. */
+	void wait(std::unique_lock<std::mutex> &lock, bool timed, std::chrono::steady_clock::time_point deadline)
+	{
+#ifdef _WIN32
+		DWORD timeout = INFINITE;
+		if (timed) {
+			using std::chrono::milliseconds;
+			const auto left = std::chrono::ceil<milliseconds>(deadline - std::chrono::steady_clock::now());
+			timeout = left.count() > 0 ? (DWORD)left.count() : 0;
+		}
+		lock.unlock();
+		// the event is auto reset: a wake() between the unlock and the wait is not lost
+		MsgWaitForMultipleObjects(1, &wakeEvent, FALSE, timeout, QS_ALLINPUT);
+		MSG msg;
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+		lock.lock();
+#else
+		if (timed)
+			cond.wait_until(lock, deadline);
+		else
+			cond.wait(lock);
+#endif
+	}
+
+	void run()
+	{
+		driver.workerStarted();
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!stopping && tasks.empty() &&
+				       (!resetPending || std::chrono::steady_clock::now() < resetDue))
+					wait(lock, resetPending, resetDue);
+				if (!tasks.empty()) {
+					task = std::move(tasks.front());
+					tasks.pop_front();
+				} else if (stopping) {
+					break;
+				} else {
+					resetPending = false;
+					task = [this]() { reset(); };
+				}
+			}
+			task();
+		}
+		driver.workerStopping();
+		state = ASIODeviceState::closed;
+	}
+
+	void reset()
+	{
+		if (!driver.driverOpen())
+			return;
+		uint64_t ticket;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// closing anyway
+			if (state == ASIODeviceState::closing)
+				return;
+			ticket = requests;
+			state = ASIODeviceState::opening;
+		}
+		const std::string err = driver.reopenDriver();
+		settle(ticket, err.empty() ? ASIODeviceState::running : ASIODeviceState::failed);
+	}
+};
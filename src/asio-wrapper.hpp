@@ -196,39 +196,8 @@ enum {
  */
 typedef double ASIOSampleRate;
 
-/* from https://app.assembla.com/spaces/portaudio/git/source/master/src/hostapi/asio/pa_asio.cpp#ln345
- * and ln405
- * enum order also: https://github.com/SjB/NAudio/blob/master/NAudio/Wave/Asio/ASIOStructures.cs#ln72
- * lot of details also here
- * https://github.com/WeAreROLI/JUCE/blob/master/modules/juce_audio_devices/native/juce_win32_ASIO.cpp#ln80
- * LSB types are little endian, MSB are big endian quite likely, we haven't found them used in the
- * hosts/drivers we studied.
- */
-typedef long ASIOSampleType;
-enum {
-	ASIOSTInt16MSB = 0,
-	ASIOSTInt24MSB = 1,
-	ASIOSTInt32MSB = 2,
-	ASIOSTFloat32MSB = 3,
-	ASIOSTFloat64MSB = 4,
-	ASIOSTInt32MSB16 = 8,
-	ASIOSTInt32MSB18 = 9,
-	ASIOSTInt32MSB20 = 10,
-	ASIOSTInt32MSB24 = 11,
-	ASIOSTInt16LSB = 16,
-	ASIOSTInt24LSB = 17,
-	ASIOSTInt32LSB = 18,
-	ASIOSTFloat32LSB = 19,
-	ASIOSTFloat64LSB = 20,
-	ASIOSTInt32LSB16 = 24,
-	ASIOSTInt32LSB18 = 25,
-	ASIOSTInt32LSB20 = 26,
-	ASIOSTInt32LSB24 = 27,
-	ASIOSTDSDInt8LSB1 = 32,
-	ASIOSTDSDInt8MSB1 = 33,
-	ASIOSTDSDInt8NER8 = 40,
-	ASIOSTLastEntry = 41, // from http://lakeofsoft.com/vc/doc/unaASIOAPI.html#ASIOSTLastEntry
-};
+/* ASIOSampleType lives in its own header so that the sample conversion code builds without windows headers. */
+#include "asio-types.h"
 
 /* from https://github.com/SjB/NAudio/blob/master/NAudio/Wave/Asio/ASIOStructures.cs#ln125
  * also https://github.com/eiz/SynchronousAudioRouter/blob/master/SarAsio/tinyasio.h#ln37
@@ -1,3 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
 
 class ByteOrder {
 public:
@@ -14,6 +21,9 @@ public:
 	/** Reverses the order of the 4 bytes in a 32-bit integer. */
 	static int32_t swap(int32_t value) noexcept;
 
+	/** Reverses the order of the 8 bytes in a 64-bit integer. */
+	static uint64_t swap(uint64_t value) noexcept;
+
 	/** Returns a garbled float which has the reverse byte-order of the original. */
 	static float swap(float value) noexcept;
 
@@ -89,13 +99,42 @@ inline float ByteOrder::swap(float v) noexcept
 	return n.asFloat;
 }
 
+inline double ByteOrder::swap(double v) noexcept
+{
+	union {
+		uint64_t asUInt;
+		double asDouble;
+	} n;
+	n.asDouble = v;
+	n.asUInt = swap(n.asUInt);
+	return n.asDouble;
+}
+
+#if defined(_MSC_VER)
 #pragma intrinsic(_byteswap_ulong)
+#pragma intrinsic(_byteswap_uint64)
 
 inline uint32_t ByteOrder::swap(uint32_t n) noexcept
 {
 	return _byteswap_ulong(n);
 }
 
+inline uint64_t ByteOrder::swap(uint64_t n) noexcept
+{
+	return _byteswap_uint64(n);
+}
+#else
+inline uint32_t ByteOrder::swap(uint32_t n) noexcept
+{
+	return __builtin_bswap32(n);
+}
+
+inline uint64_t ByteOrder::swap(uint64_t n) noexcept
+{
+	return __builtin_bswap64(n);
+}
+#endif
+
 constexpr inline uint16_t ByteOrder::makeInt(uint8_t b0, uint8_t b1) noexcept
 {
 	return static_cast<uint16_t>(static_cast<uint16_t>(b0) | (static_cast<uint16_t>(b1) << 8));
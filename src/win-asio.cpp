@@ -17,6 +17,7 @@
  */
 
 #include "asio-loader.hpp"
+#include <climits>
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("win-asio", "en-US")
 MODULE_EXPORT const char *obs_module_description(void)
@@ -39,41 +40,31 @@ static void attach_device(void *vptr, obs_data_t *settings)
 {
 	struct asio_data *data = (struct asio_data *)vptr;
 	std::string name(obs_data_get_string(settings, "device_id"));
-	for (int i = 0; i < list->deviceNames.size(); i++) {
-		if (list->deviceNames[i] == name) {
-			data->asio_device = list->attachDevice(name);
-			if (!data->asio_device) {
-				error("Failed to create device %s", name.c_str());
-			} else {
-				data->device_index = i;
-				// increment the device client list if the source was never a client
-				// & source ptr added as a client of asio device.
-				//if (data->asio_client_index[i] < 0) {
-				data->asio_client_index[i] = (int)data->asio_device->obs_clients.size();
-				data->asio_device->obs_clients.push_back(data);
-				data->asio_device->current_nb_clients++;
-				//}
-			}
-			break;
-		}
+	if (list->getIndexFromDeviceName(name) < 0)
+		return;
+	data->asio_device = list->attachDevice(name);
+	if (!data->asio_device) {
+		error("Failed to create device %s", name.c_str());
+	} else {
+		data->device_index = data->asio_device->getSlot();
+		// source ptr added as a client of asio device.
+		data->device_client[data->device_index] = true;
+		data->asio_device->addClient(data);
 	}
 }
 
-static void detach_device(void *vptr, std::string name)
+static void detach_device(void *vptr)
 {
 	struct asio_data *data = (struct asio_data *)vptr;
-	int prev_dev_idx = list->getIndexFromDeviceName(name);
-	int prev_client_idx = data->asio_client_index[prev_dev_idx];
-	data->asio_device->obs_clients[prev_client_idx] = nullptr;
-	data->asio_device->current_nb_clients--;
-	if (data->asio_device->current_nb_clients == 0)
-		data->asio_device->close();
+	data->device_client[data->asio_device->getSlot()] = false;
+	data->asio_device->removeClient(data);
+	if (data->asio_device->getNumClients() == 0)
+		data->asio_device->closeAsync();
 }
 
 static void asio_update(void *vptr, obs_data_t *settings)
 {
 	struct asio_data *data = (struct asio_data *)vptr;
-	std::string err;
 	bool swapping_device = false;
 	const char *new_device = obs_data_get_string(settings, "device_id");
 	std::string name(new_device);
@@ -88,42 +79,118 @@ static void asio_update(void *vptr, obs_data_t *settings)
 	if (!data->asio_device)
 		attach_device(data, settings);
 	else if (strcmp(data->asio_device->getName().c_str(), new_device) != 0) {
-		detach_device(data, data->asio_device->getName());
+		detach_device(data);
 		attach_device(data, settings);
 		swapping_device = true;
 	}
 
+	refresh_obs_audio_info();
+
 	ASIOAudioIODevice *asio_device = data->asio_device;
 	if (!asio_device)
 		return;
-	if (!asio_device->isOpen())
-		err = asio_device->open(asio_device->getCurrentSampleRate(), asio_device->getDefaultBufferSize());
+	// opening may take seconds with some drivers; the device does it on its own thread and the source gets audio
+	// from the first callback on
+	const std::string device_name = asio_device->getName();
+	asio_device->openAsync(0, 0, [device_name](const std::string &open_err) {
+		if (!open_err.empty())
+			error("device %s failed to open: %s", device_name.c_str(), open_err.c_str());
+	});
 
 	// update the routing
-	for (int i = 0; i < data->out_channels; i++) {
+	const int out_channels = get_audio_channels((speaker_layout)obs_data_get_int(settings, "speaker_layout"));
+	int route[MAX_AUDIO_CHANNELS];
+	for (int i = 0; i < MAX_AUDIO_CHANNELS; i++) {
 		std::string route_str = "route " + std::to_string(i);
-		if (data->route[i] != (int)obs_data_get_int(settings, route_str.c_str())) {
-			data->route[i] = (int)obs_data_get_int(settings, route_str.c_str());
-		}
+		route[i] = i < out_channels ? (int)obs_data_get_int(settings, route_str.c_str()) : -1;
+	}
+
+	const bool device_resample = obs_data_get_bool(settings, "device_resample");
+	const int packet_ms = (int)obs_data_get_int(settings, "packet_ms");
+	const bool direct_delivery = obs_data_get_bool(settings, "direct_delivery");
+
+	// update the mix matrix
+	ASIOMixMatrix *mix = nullptr;
+	const char *mix_text = obs_data_get_string(settings, "mix");
+	if (mix_text && *mix_text) {
+		std::string mix_err;
+		mix = new ASIOMixMatrix();
+		// the channel names are unknown until the device is probed; inputs out of range are then ignored
+		const int num_inputs = (int)asio_device->getInputChannelNames().size();
+		if (!mix->parse(mix_text, num_inputs ? num_inputs : INT_MAX, mix_err))
+			warn("invalid mix matrix entry ignored, %s", mix_err.c_str());
+	}
+
+	// the callback tables are rebuilt from these under the client lock, possibly on the worker thread of the device
+	ASIOMixMatrix *prev_mix = nullptr;
+	asio_device->updateClient([&]() {
+		data->out_channels = (uint8_t)out_channels;
+		memcpy(data->route, route, sizeof(route));
+		data->device_resample = device_resample;
+		data->packet_ms = packet_ms;
+		data->direct_delivery = direct_delivery;
+		prev_mix = data->fading_mix;
+		data->fading_mix = data->mix;
+		data->mix = mix;
+	});
+	// no client table refers to the matrix replaced by the previous update anymore
+	delete prev_mix;
+}
+
+static const char *asio_state_text(ASIODeviceState state)
+{
+	switch (state) {
+	case ASIODeviceState::opening:
+		return obs_module_text("Status.Connecting");
+	case ASIODeviceState::running:
+		return obs_module_text("Status.Running");
+	case ASIODeviceState::failed:
+		return obs_module_text("Status.Failed");
+	default:
+		return obs_module_text("Status.Closed");
 	}
 }
 
+/* proc handler "get_stats": timing of the device callback and frames delivered to / dropped for this source */
+static void asio_get_stats(void *vptr, calldata_t *cd)
+{
+	struct asio_data *data = (struct asio_data *)vptr;
+	std::string stats = data->asio_device ? std::string(asio_state_text(data->asio_device->getState())) + " | " +
+							data->asio_device->getStats()
+					      : "no device";
+	stats += " | frames delivered " + std::to_string(data->frames_delivered.load()) + ", dropped " +
+		 std::to_string(data->frames_dropped.load());
+	calldata_set_string(cd, "stats", stats.c_str());
+}
+
+static void asio_get_levels(void *vptr, calldata_t *cd)
+{
+	struct asio_data *data = (struct asio_data *)vptr;
+	std::string levels = data->asio_device ? data->asio_device->getLevels() : "no device";
+	calldata_set_string(cd, "levels", levels.c_str());
+}
+
 static void *asio_input_create(obs_data_t *settings, obs_source_t *source)
 {
 	struct asio_data *data = (struct asio_data *)bzalloc(sizeof(struct asio_data));
 	data->source = source;
 	data->asio_device = nullptr;
 	for (int i = 0; i < maxNumASIODevices; i++)
-		data->asio_client_index[i] = -1; // not a client if negative;
+		data->device_client[i] = false;
 	speaker_layout layout = (speaker_layout)obs_data_get_int(settings, "speaker_layout");
 	int recorded_channels = get_audio_channels(layout);
 	data->out_channels = recorded_channels;
 	data->stopping = false;
 	data->active = true;
+	data->mixer = new ASIOMixer();
 	for (int i = 0; i < MAX_AUDIO_CHANNELS; i++) {
 		data->route[i] = -1;
 	}
 
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out string stats)", asio_get_stats, data);
+	proc_handler_add(ph, "void get_levels(out string levels)", asio_get_levels, data);
+
 	asio_update(data, settings);
 	return data;
 }
@@ -133,6 +200,8 @@ static void remove_client(void *vptr)
 	struct asio_data *data = (struct asio_data *)vptr;
 	if (data->asio_device) {
 		data->stopping = true;
+		// waits until the delivery thread is done with the source, which is freed right after
+		data->asio_device->removeClient(data);
 		data->asio_device = nullptr;
 	}
 }
@@ -148,6 +217,9 @@ static void asio_destroy(void *vptr)
 	if (data->device)
 		bfree((void *)data->device);
 	remove_client(data);
+	delete data->mixer;
+	delete data->mix;
+	delete data->fading_mix;
 
 	bfree(data);
 }
@@ -163,7 +235,7 @@ static bool fill_out_channels_modified(void *vptr, obs_properties_t *props, obs_
 	obs_property_list_add_int(chanlist, obs_module_text("Mute"), -1);
 	if (!data->asio_device)
 		return true;
-	if (data->asio_client_index[data->device_index] >= 0) {
+	if (data->device_client[data->device_index]) {
 		std::vector<std::string> in_names = data->asio_device->getInputChannelNames();
 		int input_channels = (int)in_names.size();
 		for (int i = 0; i < input_channels; i++)
@@ -179,6 +251,18 @@ static bool fill_out_channels_modified(void *vptr, obs_properties_t *props, obs_
 	return true;
 }
 
+/* Lists the installed drivers and remembers which rescan the list comes from. */
+static void fill_device_list(struct asio_data *data, obs_property_t *devices)
+{
+	obs_property_list_clear(devices);
+	std::vector<std::string> DeviceNames = list->getDeviceNames();
+	for (int i = 0; i < DeviceNames.size(); i++) {
+		obs_property_list_add_string(devices, DeviceNames[i].c_str(), DeviceNames[i].c_str());
+	}
+	if (data)
+		data->device_list_generation = list->getGeneration();
+}
+
 static bool asio_device_changed(void *vptr, obs_properties_t *props, obs_property_t *devlist, obs_data_t *settings)
 {
 	struct asio_data *data = (struct asio_data *)vptr;
@@ -189,6 +273,10 @@ static bool asio_device_changed(void *vptr, obs_properties_t *props, obs_propert
 	obs_property_t *panel = obs_properties_get(props, "ctrl");
 	std::vector<obs_property_t *> route(max_channels, nullptr);
 
+	// drivers were plugged or unplugged since the list was filled
+	if (data->device_list_generation != list->getGeneration())
+		fill_device_list(data, devlist);
+
 	int itemCount = (int)obs_property_list_item_count(devlist);
 	bool itemFound = false;
 
@@ -228,7 +316,6 @@ static bool asio_layout_changed(void *vptr, obs_properties_t *props, obs_propert
 	int max_channels = MAX_AUDIO_CHANNELS;
 	speaker_layout layout = (speaker_layout)obs_data_get_int(settings, "speaker_layout");
 	int recorded_channels = get_audio_channels(layout);
-	data->out_channels = recorded_channels;
 	int i = 0;
 	for (i = 0; i < max_channels; i++) {
 		std::string name = "route " + std::to_string(i);
@@ -283,12 +370,15 @@ static obs_properties_t *asio_input_properties(void *vptr)
 	obs_property_set_modified_callback2(devices, asio_device_changed, data);
 
 	/* list of asio devices */
-	std::vector<std::string> DeviceNames = list->deviceNames;
-	for (int i = 0; i < DeviceNames.size(); i++) {
-		obs_property_list_add_string(devices, DeviceNames[i].c_str(), DeviceNames[i].c_str());
-	}
+	fill_device_list(data, devices);
 	obs_property_set_long_description(devices, obs_module_text("ASIO Devices"));
 
+	/* connection state of the device */
+	std::string status = obs_module_text("Status");
+	status += ": ";
+	status += asio_state_text(data && data->asio_device ? data->asio_device->getState() : ASIODeviceState::closed);
+	obs_properties_add_text(props, "status", status.c_str(), OBS_TEXT_INFO);
+
 	/* setting up the speaker layout on input */
 	format = obs_properties_add_list(props, "speaker_layout", obs_module_text("Format"), OBS_COMBO_TYPE_LIST,
 					 OBS_COMBO_FORMAT_INT);
@@ -307,6 +397,26 @@ static obs_properties_t *asio_input_properties(void *vptr)
 			obs_property_set_visible(route[i], false);
 	}
 
+	/* optional mix matrix, overrides the routing of the obs channels it lists */
+	obs_property_t *mix = obs_properties_add_text(props, "mix", obs_module_text("Mix"), OBS_TEXT_MULTILINE);
+	obs_property_set_long_description(mix, obs_module_text("Mix.Desc"));
+
+	obs_property_t *resample =
+		obs_properties_add_bool(props, "device_resample", obs_module_text("DeviceResample"));
+	obs_property_set_long_description(resample, obs_module_text("DeviceResample.Desc"));
+
+	/* duration of the packets sent to obs, whatever the driver buffer size */
+	obs_property_t *packet = obs_properties_add_list(props, "packet_ms", obs_module_text("PacketSize"),
+							 OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(packet, obs_module_text("PacketSize.Driver"), 0);
+	obs_property_list_add_int(packet, "5 ms", 5);
+	obs_property_list_add_int(packet, "10 ms", 10);
+	obs_property_list_add_int(packet, "20 ms", 20);
+	obs_property_set_long_description(packet, obs_module_text("PacketSize.Desc"));
+
+	obs_property_t *direct = obs_properties_add_bool(props, "direct_delivery", obs_module_text("DirectDelivery"));
+	obs_property_set_long_description(direct, obs_module_text("DirectDelivery.Desc"));
+
 	panel = obs_properties_add_button2(props, "ctrl", obs_module_text("Control Panel"), show_panel, vptr);
 
 	return props;
@@ -317,6 +427,10 @@ static void asio_defaults(obs_data_t *settings)
 	struct obs_audio_info aoi;
 	obs_get_audio_info(&aoi);
 	obs_data_set_default_string(settings, "device_id", "default");
+	obs_data_set_default_string(settings, "mix", "");
+	obs_data_set_default_bool(settings, "device_resample", false);
+	obs_data_set_default_int(settings, "packet_ms", 0);
+	obs_data_set_default_bool(settings, "direct_delivery", false);
 	obs_data_set_default_int(settings, "speaker_layout", aoi.speakers);
 	int recorded_channels = get_audio_channels(aoi.speakers);
 
@@ -365,6 +479,7 @@ bool obs_module_load(void)
 {
 	list = new ASIOAudioIODeviceList();
 	list->scanForDevices();
+	refresh_obs_audio_info();
 	register_asio_source();
 	info("plugin loaded successfully (version %s)", PLUGIN_VERSION);
 	if (os_sem_init(&shutting_down, 0) != 0)
@@ -0,0 +1,92 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Minimal benchmark harness: benches register themselves and print one json object per measurement.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct ASIOBench {
+	const char *name;
+	void (*run)(bool quick);
+};
+
+std::vector<ASIOBench> &asioBenches();
+
+struct ASIOBenchRegistrar {
+	ASIOBenchRegistrar(const char *name, void (*run)(bool)) { asioBenches().push_back({name, run}); }
+};
+
+/* ASIO_BENCH(convert) { ... } defines a bench run by "asio-bench convert"; quick asks for a smoke run. */
+#define ASIO_BENCH(name)                                                   \
+	static void bench_##name(bool quick);                              \
+	static ASIOBenchRegistrar bench_##name##_registrar(#name, bench_##name); \
+	static void bench_##name(bool quick)
+
+//============================================================================
+/* One line of output, e.g. {"bench":"convert","type":"Int24LSB","ns_per_sample":0.41} */
+class ASIOBenchRow {
+public:
+	explicit ASIOBenchRow(const char *bench) : text(std::string("{\"bench\":\"") + bench + "\"") {}
+
+	ASIOBenchRow &add(const char *key, const char *value)
+	{
+		text += std::string(",\"") + key + "\":\"" + value + "\"";
+		return *this;
+	}
+
+	ASIOBenchRow &add(const char *key, double value)
+	{
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%.6g", value);
+		text += std::string(",\"") + key + "\":" + buf;
+		return *this;
+	}
+
+	ASIOBenchRow &add(const char *key, int value) { return add(key, (double)value); }
+
+	void print() const
+	{
+		printf("%s}\n", text.c_str());
+		fflush(stdout);
+	}
+
+private:
+	std::string text;
+};
+
+/* Calls fn until at least minNs nanoseconds and minCalls calls went by; returns the mean ns per call. */
+template<class F> double asioTimeCalls(F &&fn, double minNs, int minCalls)
+{
+	using clock = std::chrono::steady_clock;
+	long long calls = 0;
+	const auto start = clock::now();
+	double elapsed = 0.0;
+
+	fn(); // warm the caches and the branch predictors
+	do {
+		for (int i = 0; i < minCalls; i++)
+			fn();
+		calls += minCalls;
+		elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+	} while (elapsed < minNs);
+	return elapsed / (double)calls;
+}
@@ -0,0 +1,61 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Minimal test harness: tests register themselves, failed checks are reported and counted.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+struct ASIOTest {
+	const char *name;
+	void (*run)();
+};
+
+std::vector<ASIOTest> &asioTests();
+extern int asioTestFailures;
+
+struct ASIOTestRegistrar {
+	ASIOTestRegistrar(const char *name, void (*run)()) { asioTests().push_back({name, run}); }
+};
+
+/* ASIO_TEST(convert_int24) { ... } defines a test run by "asio-tests convert" or "asio-tests convert_int24". */
+#define ASIO_TEST(name)                                                 \
+	static void test_##name();                                      \
+	static ASIOTestRegistrar test_##name##_registrar(#name, test_##name); \
+	static void test_##name()
+
+/* Reports a failed check and goes on; the test fails at the end. */
+#define ASIO_CHECK(cond)                                                                      \
+	do {                                                                                  \
+		if (!(cond)) {                                                                \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			asioTestFailures++;                                                   \
+		}                                                                             \
+	} while (0)
+
+/* Same, with a printf style description of the failing case. */
+#define ASIO_CHECK_MSG(cond, ...)                                                             \
+	do {                                                                                  \
+		if (!(cond)) {                                                                \
+			fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+			fprintf(stderr, __VA_ARGS__);                                         \
+			fprintf(stderr, "\n");                                                \
+			asioTestFailures++;                                                   \
+		}                                                                             \
+	} while (0)
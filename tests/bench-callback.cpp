@@ -0,0 +1,271 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Cost of the conversion part of the driver callback (ASIOAudioIODevice::processBuffer) at small buffer sizes.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <random>
+#include "asio-bench.hpp"
+#include "asio-meter.hpp"
+#include "asio-resample.hpp"
+#include "asio-ring.hpp"
+#include "sample-types.hpp"
+
+/* Device side of a period: the driver buffers of each input and their formats, resolved when the device opened. */
+struct BenchDevice {
+	int channels, frames;
+	std::vector<ASIOSampleFormat> formats;
+	std::vector<std::vector<char>> buffers;
+	ASIOBlockRing ring;
+	ASIOLevelMeter meter;
+	ASIOChannelMask routed;
+
+	BenchDevice(long type, int numChannels, int numFrames) : channels(numChannels), frames(numFrames)
+	{
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+		std::vector<float> noise(frames);
+
+		formats.assign(channels, ASIOSampleFormat(type));
+		buffers.resize(channels);
+		for (int i = 0; i < channels; i++) {
+			for (float &f : noise)
+				f = dist(rng);
+			buffers[i].resize((size_t)frames * formats[i].byteStride);
+			formats[i].convertFromFloat(noise.data(), buffers[i].data(), frames);
+		}
+		ring.resize(4, channels, frames);
+		meter.reset(channels);
+		routed.resize(channels);
+	}
+
+	/* What deliverDirect does for native float inputs: metering, and the source packet pointing into the driver
+	 * buffers.
+	 */
+	void direct(const float **packet) noexcept
+	{
+		routed.forEach([&](int i) {
+			const float *src = (const float *)buffers[i].data();
+			meter.measure(i, src, frames);
+			packet[i] = src;
+		});
+	}
+
+	/* What processBuffer does for the routed inputs of a pcm device: silence check, conversion, metering. */
+	void period(const ASIOSampleFormat *format) noexcept
+	{
+		ASIOAudioBlock *block = ring.beginWrite();
+		routed.forEach([&](int i) {
+			const void *src = buffers[i].data();
+			if (ASIOLevelMeter::isSilent(src, (size_t)frames * format[i].byteStride)) {
+				meter.silence(i);
+				return;
+			}
+			format[i].toFloat(src, ring.channel(*block, i), frames);
+			meter.measure(i, ring.channel(*block, i), frames);
+		});
+		ring.endWrite();
+		ring.beginRead();
+		ring.endRead();
+	}
+};
+
+static const long callbackTypes[] = {ASIOSTInt16LSB, ASIOSTInt24LSB, ASIOSTInt32LSB, ASIOSTFloat32LSB,
+				     ASIOSTInt32MSB};
+
+/* 2 to 256 channels, doubling: the cost per channel must stay flat up to MADI and Dante channel counts. */
+static const int scalingChannels[] = {2, 4, 8, 16, 32, 64, 128, 256};
+
+/* Converters resolved once at open, as the device does, against resolving them again on every callback. */
+ASIO_BENCH(callback)
+{
+	for (long type : callbackTypes) {
+		for (int frames : {32, 64}) {
+			for (int channels : scalingChannels) {
+				BenchDevice device(type, channels, frames);
+				for (int i = 0; i < channels; i++)
+					device.routed.set(i);
+				std::vector<ASIOSampleFormat> perCall(channels);
+
+				for (int resolved = 0; resolved < 2; resolved++) {
+					const double ns = asioTimeCalls(
+						[&]() {
+							if (!resolved) {
+								for (int i = 0; i < channels; i++)
+									perCall[i] = ASIOSampleFormat(type);
+								device.period(perCall.data());
+							} else {
+								device.period(device.formats.data());
+							}
+						},
+						quick ? 0.0 : 2e7, quick ? 1 : 64);
+					ASIOBenchRow("callback")
+						.add("isa", asioIsaName())
+						.add("type", asioSampleTypeName(type))
+						.add("mode", resolved ? "resolved_at_open" : "resolved_per_callback")
+						.add("frames", frames)
+						.add("channels", channels)
+						.add("ns_per_callback", ns)
+						.add("ns_per_channel", ns / channels)
+						.add("ns_per_sample", ns / ((double)frames * channels))
+						.print();
+				}
+			}
+		}
+	}
+}
+
+/* Interfaces of 2 to 256 inputs of which a source reads 2, 8 or all channels: only the routed ones are converted. */
+ASIO_BENCH(routed)
+{
+	for (long type : {ASIOSTInt24LSB, ASIOSTInt32LSB}) {
+		for (int frames : {64, 256, 1024}) {
+			for (int inputs : scalingChannels) {
+				BenchDevice device(type, inputs, frames);
+				double all = 0.0;
+				for (int routed : {inputs, 8, 2}) {
+					// all of them first, then 8 and 2 of the larger interfaces
+					if (routed >= inputs && all > 0.0)
+						continue;
+					device.routed.clear();
+					for (int i = 0; i < routed; i++)
+						device.routed.set(i);
+					const double ns = asioTimeCalls([&]() { device.period(device.formats.data()); },
+									quick ? 0.0 : 2e7, quick ? 1 : 64);
+					if (routed == inputs)
+						all = ns;
+					ASIOBenchRow("routed")
+						.add("isa", asioIsaName())
+						.add("type", asioSampleTypeName(type))
+						.add("frames", frames)
+						.add("inputs", inputs)
+						.add("routed", routed)
+						.add("ns_per_callback", ns)
+						.add("ns_per_routed_channel", ns / routed)
+						.add("speedup", all / ns)
+						.print();
+				}
+			}
+		}
+	}
+}
+
+/* Native Float32LSB inputs copied into the ring for the delivery thread, against passed to obs as they are from the
+ * driver thread (direct_delivery). bytes_copied is the memory traffic the direct path saves on every period.
+ */
+ASIO_BENCH(direct)
+{
+	for (int frames : {64, 256}) {
+		for (int channels : scalingChannels) {
+			BenchDevice device(ASIOSTFloat32LSB, channels, frames);
+			for (int i = 0; i < channels; i++)
+				device.routed.set(i);
+			std::vector<const float *> packet(channels);
+
+			double copied = 0.0;
+			for (int direct = 0; direct < 2; direct++) {
+				const double ns = asioTimeCalls(
+					[&]() {
+						if (direct)
+							device.direct(packet.data());
+						else
+							device.period(device.formats.data());
+					},
+					quick ? 0.0 : 2e7, quick ? 1 : 64);
+				if (!direct)
+					copied = ns;
+				ASIOBenchRow("direct")
+					.add("isa", asioIsaName())
+					.add("mode", direct ? "direct" : "ring")
+					.add("frames", frames)
+					.add("channels", channels)
+					.add("ns_per_callback", ns)
+					.add("ns_per_channel", ns / channels)
+					.add("bytes_copied", direct ? 0 : frames * channels * (int)sizeof(float))
+					.add("speedup", copied / ns)
+					.print();
+			}
+		}
+	}
+}
+
+/* Eight stereo sources on a 32 input device at 96 kHz with obs at 48 kHz. Shared: the device resamples each channel
+ * read by some source once and skips the others (device_resample). Per source: every source resamples the channels it
+ * reads on its own, as libobs does for each source, here with the same filter so that only the work repeated counts.
+ * The sources either all read inputs 1-2, or each its own pair.
+ */
+ASIO_BENCH(resample)
+{
+	const int inputs = 32, sources = 8, inRate = 96000, outRate = 48000;
+	auto filter = std::make_shared<const ASIOResampleFilter>(inRate, outRate);
+
+	for (int frames : {64, 256, 1024}) {
+		BenchDevice device(ASIOSTFloat32LSB, inputs, frames);
+		std::vector<std::vector<float>> in(inputs, std::vector<float>(frames));
+		for (int i = 0; i < inputs; i++)
+			device.formats[i].toFloat(device.buffers[i].data(), in[i].data(), frames);
+		std::vector<float> out(filter->maxOutput(frames));
+
+		for (bool samePair : {true, false}) {
+			// channel read by each side of each source
+			std::vector<int> route;
+			for (int n = 0; n < sources; n++) {
+				route.push_back(samePair ? 0 : 2 * n);
+				route.push_back(samePair ? 1 : 2 * n + 1);
+			}
+			ASIOChannelMask used;
+			used.resize(inputs);
+			for (int ch : route)
+				used.set(ch);
+
+			std::vector<ASIOResampler> shared, perSource;
+			for (int i = 0; i < inputs; i++)
+				shared.emplace_back(filter, frames);
+			for (size_t k = 0; k < route.size(); k++)
+				perSource.emplace_back(filter, frames);
+
+			const double sharedNs = asioTimeCalls(
+				[&]() {
+					for (int i = 0; i < inputs; i++) {
+						if (used.test(i))
+							shared[i].process(in[i].data(), frames, out.data());
+						else
+							shared[i].skip(frames);
+					}
+				},
+				quick ? 0.0 : 2e7, quick ? 1 : 64);
+			const double perSourceNs = asioTimeCalls(
+				[&]() {
+					for (size_t k = 0; k < route.size(); k++)
+						perSource[k].process(in[route[k]].data(), frames, out.data());
+				},
+				quick ? 0.0 : 2e7, quick ? 1 : 64);
+
+			for (int mode = 0; mode < 2; mode++) {
+				ASIOBenchRow("resample")
+					.add("isa", asioIsaName())
+					.add("mode", mode ? "per_source" : "shared")
+					.add("sources", samePair ? "same_pair" : "own_pair")
+					.add("frames", frames)
+					.add("inputs", inputs)
+					.add("taps", filter->taps)
+					.add("ns_per_callback", mode ? perSourceNs : sharedNs)
+					.add("speedup", perSourceNs / (mode ? perSourceNs : sharedNs))
+					.print();
+			}
+		}
+	}
+}
@@ -0,0 +1,113 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include "asio-bench.hpp"
+#include "fake-driver.hpp"
+
+using namespace std::chrono;
+
+/* A driver slow to probe, as USB interfaces which ask the device for every rate: the probe openDevice() runs when
+ * the device is created goes through the cache, then the driver starts streaming after startDelay.
+ */
+class SlowProbeDriver : public FakeDriver {
+public:
+	static constexpr int inputs = 8, outputs = 2;
+	milliseconds rateCheck{5};        // one canSampleRate() call
+	microseconds nameRead{500};       // one getChannelInfo() call
+	milliseconds dummyStart{80 + 20}; // the cubase style start, sleep and stop, with the dummy buffers
+	int probes = 0;
+
+	explicit SlowProbeDriver(ASIOCapsCache &capsCache) : cache(capsCache) {}
+
+	std::string openDriver(double sampleRate, int bufferSize) override
+	{
+		if (!created) {
+			ASIODriverCaps caps;
+			cache.probeOrLoad(key, inputs, outputs, caps,
+					  [this](ASIODriverCaps &probed) { return probe(probed); });
+			created = true;
+		}
+		return FakeDriver::openDriver(sampleRate, bufferSize);
+	}
+
+private:
+	ASIOCapsCache &cache;
+	const std::string key = ASIOCapsCache::key("{8C5E0F8A-6E1C-4B0F-9A6F-5F0B1C2D3E4F}", 3);
+	bool created = false; // openDevice() has run
+
+	bool probe(ASIODriverCaps &caps)
+	{
+		probes++;
+		caps.numInputs = inputs;
+		caps.numOutputs = outputs;
+		for (int rate : {8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000, 88200, 96000, 176400, 192000,
+				 352800, 384000, 705600, 768000}) {
+			std::this_thread::sleep_for(rateCheck);
+			if (rate >= 44100 && rate <= 192000)
+				caps.sampleRates.push_back(rate);
+		}
+		caps.minBufferSize = 32;
+		caps.maxBufferSize = 2048;
+		caps.preferredBufferSize = 256;
+		caps.bufferGranularity = -1;
+		for (int i = 0; i < inputs + outputs; i++) {
+			std::this_thread::sleep_for(nameRead);
+			(i < inputs ? caps.inputNames : caps.outputNames).push_back("Channel " + std::to_string(i + 1));
+		}
+		std::this_thread::sleep_for(dummyStart);
+		return true;
+	}
+};
+
+/* Time from the first source asking for a device to the device streaming, on the first start of obs with a driver
+ * (cold: probed, then cached) and on the next ones (warm: read from the cache). The driver costs are simulated, see
+ * SlowProbeDriver; streaming starts 50 ms after the open.
+ */
+ASIO_BENCH(startup)
+{
+	const int runs = quick ? 1 : 5;
+	auto file = std::make_shared<std::string>();
+	double coldMs = 0.0, warmMs = 0.0;
+
+	for (int run = 0; run < runs; run++) {
+		file->clear();
+		for (double *ms : {&coldMs, &warmMs}) {
+			ASIOCapsCache cache(std::make_unique<MemoryCapsFile>(file));
+			SlowProbeDriver driver(cache);
+			driver.startDelay = milliseconds(50);
+			ASIODeviceWorker worker(driver);
+			worker.start();
+			const auto before = steady_clock::now();
+			worker.openAsync(0, 0).get();
+			*ms += duration<double, std::milli>(steady_clock::now() - before).count() / runs;
+			if (driver.probes != (ms == &coldMs ? 1 : 0))
+				fprintf(stderr, "startup: %d probes on a %s start\n", driver.probes,
+					ms == &coldMs ? "cold" : "warm");
+			worker.closeAsync().get();
+		}
+	}
+
+	for (const char *start : {"cold", "warm"}) {
+		ASIOBenchRow("startup")
+			.add("start", start)
+			.add("ms", start[0] == 'c' ? coldMs : warmMs)
+			.add("rate_check_ms", 5)
+			.add("dummy_start_ms", 100)
+			.add("stream_start_ms", 50)
+			.print();
+	}
+}
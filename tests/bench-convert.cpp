@@ -0,0 +1,80 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Throughput of the sample converters: every pcm sample type, both directions, over the buffer sizes and channel
+ * counts drivers use.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <random>
+#include "asio-bench.hpp"
+#include "sample-types.hpp"
+
+static const int benchFrames[] = {32, 64, 128, 256, 512, 1024, 2048};
+static const int benchChannels[] = {2, 8, 16, 32, 64};
+
+/* Converts a whole device period, channel after channel, like the callback does. */
+static void benchFormat(const ASIOSampleTypeName &type, bool quick)
+{
+	const ASIOSampleFormat format(type.type);
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	for (int frames : benchFrames) {
+		for (int channels : benchChannels) {
+			const size_t samples = (size_t)frames * channels;
+			std::vector<float> floats(samples);
+			std::vector<char> device(samples * format.byteStride);
+			for (float &f : floats)
+				f = dist(rng);
+			// valid device samples, e.g. no nan in the float formats
+			for (int c = 0; c < channels; c++)
+				format.convertFromFloat(&floats[(size_t)c * frames],
+							&device[(size_t)c * frames * format.byteStride], frames);
+
+			for (int direction = 0; direction < 2; direction++) {
+				const bool toFloat = direction == 0;
+				const double ns = asioTimeCalls(
+					[&]() {
+						for (int c = 0; c < channels; c++) {
+							float *f = &floats[(size_t)c * frames];
+							char *d = &device[(size_t)c * frames * format.byteStride];
+							if (toFloat)
+								format.convertToFloat(d, f, frames);
+							else
+								format.convertFromFloat(f, d, frames);
+						}
+					},
+					quick ? 0.0 : 1e7, quick ? 1 : 16);
+				const double nsPerSample = ns / (double)samples;
+				ASIOBenchRow("convert")
+					.add("isa", asioIsaName())
+					.add("type", type.name)
+					.add("direction", toFloat ? "to_float" : "from_float")
+					.add("frames", frames)
+					.add("channels", channels)
+					.add("ns_per_sample", nsPerSample)
+					.add("gb_per_s", (format.byteStride + sizeof(float)) / nsPerSample)
+					.print();
+			}
+		}
+	}
+}
+
+ASIO_BENCH(convert)
+{
+	for (const ASIOSampleTypeName &type : asioPcmSampleTypes)
+		benchFormat(type, quick);
+}
@@ -0,0 +1,52 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * DSD decimation throughput, in channels one core can decimate in real time.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include "asio-bench.hpp"
+#include "asio-dsd.hpp"
+#include "dsd-signal.hpp"
+
+ASIO_BENCH(dsd)
+{
+	const struct {
+		const char *name;
+		double rate;
+	} rates[] = {{"DSD64", 2822400.0}, {"DSD128", 5644800.0}, {"DSD256", 11289600.0}};
+
+	for (const auto &r : rates) {
+		const int decimation = DSDDecimationFilter::decimationForRate(r.rate);
+		auto filter = std::make_shared<const DSDDecimationFilter>(decimation, false);
+		DSDDecimator decimator(filter, false);
+		// one 512 frame period of the driver, 8 bits per byte
+		const int bytes = 512 / 8 * (decimation / 8);
+		const std::vector<uint8_t> stream = dsdSine(r.rate, 1000.0, 0.5, bytes);
+		std::vector<float> pcm(bytes);
+
+		const double ns = asioTimeCalls([&]() { decimator.process(stream.data(), bytes, pcm.data()); },
+						quick ? 0.0 : 1e8, quick ? 1 : 64);
+		const double nsPerByte = ns / bytes;
+		// one channel needs rate / 8 bytes a second
+		const double channelsPerCore = 1e9 / (nsPerByte * r.rate / 8.0);
+		ASIOBenchRow("dsd")
+			.add("rate", r.name)
+			.add("pcm_rate", r.rate / decimation)
+			.add("ns_per_byte", nsPerByte)
+			.add("channels_per_core", channelsPerCore)
+			.print();
+	}
+}
@@ -0,0 +1,52 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <cstring>
+#include "asio-bench.hpp"
+
+std::vector<ASIOBench> &asioBenches()
+{
+	static std::vector<ASIOBench> benches;
+	return benches;
+}
+
+/* asio-bench [name prefix] [--quick] */
+int main(int argc, char **argv)
+{
+	const char *filter = "";
+	bool quick = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--quick"))
+			quick = true;
+		else
+			filter = argv[i];
+	}
+
+	int count = 0;
+	for (const ASIOBench &bench : asioBenches()) {
+		if (strncmp(bench.name, filter, strlen(filter)) != 0)
+			continue;
+		bench.run(quick);
+		count++;
+	}
+	if (!count) {
+		fprintf(stderr, "no bench matches \"%s\"\n", filter);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <cstring>
+#include <string>
+#include "asio-bench.hpp"
+#include "asio-mix.hpp"
+
+/* Stands for what obs does with the audio of one source: obs_source_output_audio() copies each packet, upmixed to
+ * the output layout, into the buffer of the source; the audio thread then applies the source volume and adds it to
+ * the mix. Filters, monitoring, locks and the per source resampler are left out, so this is a lower bound.
+ */
+struct BenchObsMix {
+	static constexpr int outputs = 2;
+	std::vector<float> buffer[outputs];
+	std::vector<float> mix[outputs];
+
+	explicit BenchObsMix(int frames)
+	{
+		for (int c = 0; c < outputs; c++) {
+			buffer[c].assign(frames, 0.0f);
+			mix[c].assign(frames, 0.0f);
+		}
+	}
+
+	/* channels[c] is output c of the source; a mono source has a single channel, which obs plays on both. */
+	void output(const float *const *channels, int numChannels, int frames, float volume)
+	{
+		for (int c = 0; c < outputs; c++)
+			memcpy(buffer[c].data(), channels[c < numChannels ? c : 0], frames * sizeof(float));
+		for (int c = 0; c < outputs; c++) {
+			float *src = buffer[c].data();
+			float *dest = mix[c].data();
+			for (int i = 0; i < frames; i++)
+				src[i] *= volume;
+			for (int i = 0; i < frames; i++)
+				dest[i] += src[i];
+		}
+	}
+};
+
+/* One second of 48 kHz audio in 480 frame packets, with 2 to 8 mono mics mixed to stereo: either one source with a
+ * mix matrix summing the mics into its two channels, or, as done without a matrix, one mono source per mic which obs
+ * upmixes and sums. ns_per_second covers the mixer, if any, and the obs side modelled above.
+ */
+ASIO_BENCH(mix)
+{
+	const int rate = 48000, frames = 480, packets = rate / frames;
+	const int numInputs = 8;
+	std::vector<std::vector<float>> planes(numInputs, std::vector<float>(frames));
+	std::vector<const float *> inputs(numInputs);
+	for (int i = 0; i < numInputs; i++) {
+		for (int k = 0; k < frames; k++)
+			planes[i][k] = 0.1f * (float)((i + k) % 7) - 0.3f;
+		inputs[i] = planes[i].data();
+	}
+	int route[ASIOMixMatrix::maxOutputs];
+	for (int n = 0; n < ASIOMixMatrix::maxOutputs; n++)
+		route[n] = n < numInputs ? n : -1;
+
+	for (int mics : {2, 4, 8}) {
+		// each mic panned by its own gains to the left and right channels
+		std::string text;
+		for (int out = 1; out <= 2; out++) {
+			text += std::to_string(out) + " =";
+			for (int m = 0; m < mics; m++)
+				text += std::string(m ? " +" : " ") + std::to_string(m + 1) + "*" +
+					std::to_string(out == 1 ? 0.9 - 0.1 * m : 0.2 + 0.1 * m);
+			text += "\n";
+		}
+		ASIOMixMatrix matrix;
+		std::string error;
+		matrix.parse(text.c_str(), numInputs, error);
+		ASIOMixer mixer;
+		BenchObsMix matrixObs(frames);
+		const double matrixNs = asioTimeCalls(
+			[&]() {
+				for (int p = 0; p < packets; p++) {
+					mixer.process(&matrix, route, inputs.data(), numInputs, frames, rate);
+					const float *out[2] = {mixer.output(0), mixer.output(1)};
+					matrixObs.output(out, 2, frames, 1.0f);
+				}
+			},
+			quick ? 0.0 : 2e8, 1);
+
+		BenchObsMix sourcesObs(frames);
+		const double sourcesNs = asioTimeCalls(
+			[&]() {
+				for (int p = 0; p < packets; p++)
+					for (int m = 0; m < mics; m++)
+						sourcesObs.output(&inputs[m], 1, frames, 0.5f);
+			},
+			quick ? 0.0 : 2e8, 1);
+
+		ASIOBenchRow("mix")
+			.add("mics", mics)
+			.add("frames", frames)
+			.add("matrix_ns_per_second", matrixNs)
+			.add("sources_ns_per_second", sourcesNs)
+			.add("speedup", sourcesNs / matrixNs)
+			.print();
+	}
+}
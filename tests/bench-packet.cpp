@@ -0,0 +1,103 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Packets sent to obs with and without the packetizer, for tiny and huge driver buffers.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <cmath>
+#include <cstring>
+#include "asio-bench.hpp"
+#include "asio-packet.hpp"
+
+/* Stands for obs_source_output_audio(), which copies every packet into the circular buffer of the source. */
+struct BenchObsSource {
+	std::vector<std::vector<float>> circular;
+	size_t at = 0;
+	uint64_t calls = 0, lastTimestamp = 0;
+	double spacingSum = 0.0, spacingSquares = 0.0, spacingMax = 0.0;
+	int spacings = 0;
+
+	BenchObsSource(int channels, size_t frames) : circular(channels, std::vector<float>(frames)) {}
+
+	void output(const ASIOPacket &packet)
+	{
+		if (at + packet.frames > circular[0].size())
+			at = 0;
+		for (size_t i = 0; i < circular.size(); i++)
+			memcpy(circular[i].data() + at, packet.channels[i], packet.frames * sizeof(float));
+		at += packet.frames;
+		if (calls++) {
+			const double ms = (double)(packet.timestamp - lastTimestamp) / 1e6;
+			spacingSum += ms;
+			spacingSquares += ms * ms;
+			spacingMax = std::fmax(spacingMax, ms);
+			spacings++;
+		}
+		lastTimestamp = packet.timestamp;
+	}
+};
+
+/* One second of 8 channel audio at 48 kHz in periods of 32 or 2048 frames, sent to obs as they are or in 480 frame
+ * (10 ms) packets. ns_per_second covers the packetizer and the copy obs makes of each packet; obs adds its own cost
+ * per call on top. The spacing is the time between the stamps of two packets, which obs buffers against.
+ */
+ASIO_BENCH(packet)
+{
+	const int channels = 8, rate = 48000;
+
+	for (int periodFrames : {32, 64, 2048}) {
+		std::vector<std::vector<float>> period(channels, std::vector<float>(periodFrames, 0.25f));
+		std::vector<const float *> inputs(channels);
+		for (int i = 0; i < channels; i++)
+			inputs[i] = period[i].data();
+		const int periods = rate / periodFrames;
+
+		for (int packetFrames : {0, 480}) {
+			ASIOPacketizer packetizer;
+			packetizer.reset(channels, packetFrames);
+			BenchObsSource obs(channels, (size_t)rate);
+			uint64_t position = 0;
+
+			const double ns = asioTimeCalls(
+				[&]() {
+					for (int p = 0; p < periods; p++) {
+						const uint64_t stamp = (uint64_t)std::llround(position * 1e9 / rate);
+						packetizer.push(inputs.data(), periodFrames, stamp, rate);
+						position += periodFrames;
+						while (const ASIOPacket *packet = packetizer.pop())
+							obs.output(*packet);
+					}
+				},
+				quick ? 0.0 : 2e8, 1);
+			const double seconds = (double)position / rate;
+			const double callsPerSecond = (double)obs.calls / seconds;
+			const double nsPerSecond = ns * (double)rate / ((double)periods * periodFrames);
+			const double mean = obs.spacingSum / obs.spacings;
+			const double variance = obs.spacingSquares / obs.spacings - mean * mean;
+			ASIOBenchRow("packet")
+				.add("period_frames", periodFrames)
+				.add("packet_frames", packetFrames)
+				.add("channels", channels)
+				.add("calls_per_second", callsPerSecond)
+				.add("ns_per_second", nsPerSecond)
+				.add("ns_per_call", nsPerSecond / callsPerSecond)
+				.add("spacing_mean_ms", mean)
+				.add("spacing_stddev_ms", std::sqrt(std::fmax(0.0, variance)))
+				.add("spacing_max_ms", obs.spacingMax)
+				.print();
+		}
+	}
+}
@@ -0,0 +1,127 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Handoff of periods from a driver-like thread to a delivery thread which stalls now and then, like obs does.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "asio-bench.hpp"
+#include "asio-ring.hpp"
+#include "asio-stats.hpp"
+
+/* Stands for the os_sem_t the device posts once per period. */
+class BenchSemaphore {
+public:
+	void post()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			count++;
+		}
+		cond.notify_one();
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this]() { return count > 0; });
+		count--;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable cond;
+	int count = 0;
+};
+
+static uint64_t nowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+/* 64 frame periods at 48 kHz over 32 channels; the consumer stalls 50 ms every second. The driver side must keep
+ * its cost flat and drop periods rather than wait; the handoff latency is measured up to the delivery thread.
+ */
+ASIO_BENCH(ring)
+{
+	const int frames = 64, channels = 32, rate = 48000;
+	const int periods = quick ? 50 : 3000;
+	const uint64_t periodNs = (uint64_t)frames * 1000000000ull / rate;
+	const int stallEvery = rate / frames; // 1 s
+
+	ASIOBlockRing ring;
+	ring.resize((int)(rate * 0.1 / frames) + 1, channels, frames); // 100 ms, as the device does
+	BenchSemaphore sem;
+	ASIOHistogram writeCost, handoff;
+	std::atomic<bool> stop{false};
+	uint64_t dropped = 0, misses = 0;
+	std::vector<float> source((size_t)frames, 0.25f);
+
+	std::thread consumer([&]() {
+		int delivered = 0;
+		while (!stop) {
+			sem.wait();
+			while (ASIOAudioBlock *block = ring.beginRead()) {
+				handoff.record(nowNs() - block->timestamp);
+				ring.endRead();
+				if (++delivered % stallEvery == 0)
+					std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			}
+		}
+	});
+
+	auto next = std::chrono::steady_clock::now();
+	for (int p = 0; p < periods; p++) {
+		next += std::chrono::nanoseconds(periodNs);
+		std::this_thread::sleep_until(next);
+		const uint64_t start = nowNs();
+		if (ASIOAudioBlock *block = ring.beginWrite()) {
+			for (int c = 0; c < channels; c++)
+				memcpy(ring.channel(*block, c), source.data(), frames * sizeof(float));
+			block->frames = frames;
+			block->timestamp = nowNs();
+			ring.endWrite();
+			sem.post();
+		} else {
+			dropped++;
+		}
+		const uint64_t cost = nowNs() - start;
+		writeCost.record(cost);
+		misses += cost > periodNs ? 1 : 0;
+	}
+	stop = true;
+	sem.post();
+	consumer.join();
+
+	ASIOBenchRow("ring")
+		.add("frames", frames)
+		.add("channels", channels)
+		.add("periods", periods)
+		.add("dropped", (double)dropped)
+		.add("deadline_misses", (double)misses)
+		.add("write_p50_us", (double)writeCost.percentile(0.5))
+		.add("write_p99_us", (double)writeCost.percentile(0.99))
+		.add("write_max_us", (double)writeCost.maximum())
+		.add("handoff_p50_us", (double)handoff.percentile(0.5))
+		.add("handoff_p99_us", (double)handoff.percentile(0.99))
+		.add("handoff_max_us", (double)handoff.maximum())
+		.print();
+}
@@ -0,0 +1,40 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Encodes a sine as a DSD bitstream, msb first, with a second order sigma-delta modulator. */
+inline std::vector<uint8_t> dsdSine(double dsdRate, double frequency, double amplitude, int numBytes)
+{
+	const double pi = 3.14159265358979323846;
+	std::vector<uint8_t> bytes(numBytes, 0);
+	double i1 = 0.0, i2 = 0.0, y = 0.0;
+
+	for (int n = 0; n < numBytes * 8; n++) {
+		const double x = amplitude * std::sin(2.0 * pi * frequency * n / dsdRate);
+		i1 += x - y;
+		i2 += i1 - y;
+		y = i2 >= 0.0 ? 1.0 : -1.0;
+		if (y > 0.0)
+			bytes[n / 8] |= (uint8_t)(0x80 >> (n % 8));
+	}
+	return bytes;
+}
@@ -0,0 +1,115 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Stand-in for an ASIO driver behind the device worker: opening takes a configurable time, every call is counted
+ * and checked to run on the worker thread, one at a time.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include "asio-caps.hpp"
+#include "asio-worker.hpp"
+
+class FakeDriver : public ASIOWorkerDriver {
+public:
+	std::chrono::milliseconds startDelay{0}; // time the driver takes to start streaming
+	std::string openError;                    // returned by the next opens, empty for success
+	std::atomic<int> clients{0};
+
+	std::atomic<int> opens{0}, closes{0}, reopens{0};
+	std::atomic<int> misplaced{0}; // calls made off the worker thread or while another one runs
+	std::atomic<bool> open{false};
+
+	void workerStarted() override { workerThread = std::this_thread::get_id(); }
+
+	std::string openDriver(double, int) override
+	{
+		const Call call(*this);
+		open = false;
+		std::this_thread::sleep_for(startDelay);
+		if (!openError.empty())
+			return openError;
+		open = true;
+		opens++;
+		return std::string();
+	}
+
+	void closeDriver() override
+	{
+		const Call call(*this);
+		open = false;
+		closes++;
+	}
+
+	bool driverOpen() override { return open; }
+
+	std::string reopenDriver() override
+	{
+		const Call call(*this);
+		std::this_thread::sleep_for(startDelay);
+		reopens++;
+		return std::string();
+	}
+
+	int attachedClients() override { return clients; }
+
+private:
+	std::thread::id workerThread;
+	std::atomic<bool> busy{false};
+
+	struct Call {
+		FakeDriver &driver;
+		explicit Call(FakeDriver &d) : driver(d)
+		{
+			if (driver.busy.exchange(true) || std::this_thread::get_id() != driver.workerThread)
+				driver.misplaced++;
+		}
+		~Call() { driver.busy = false; }
+	};
+};
+
+/* Stands for driver-caps.txt: caches made on the same text share the file, as successive runs of obs do. An empty
+ * text is no file.
+ */
+class MemoryCapsFile : public ASIOCapsFile {
+public:
+	explicit MemoryCapsFile(std::shared_ptr<std::string> fileText) : text(std::move(fileText)) {}
+
+	bool read(std::string &out) override
+	{
+		if (text->empty())
+			return false;
+		out = *text;
+		return true;
+	}
+
+	bool write(const std::string &in) override
+	{
+		*text = in;
+		writes++;
+		return true;
+	}
+
+	int writes = 0;
+
+private:
+	std::shared_ptr<std::string> text;
+};
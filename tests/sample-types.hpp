@@ -0,0 +1,50 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include "asio-convert.hpp"
+
+/* The pcm sample types the plugin converts, with their sdk names minus the ASIOST prefix. */
+struct ASIOSampleTypeName {
+	long type;
+	const char *name;
+};
+
+static const ASIOSampleTypeName asioPcmSampleTypes[] = {
+	{ASIOSTInt16MSB, "Int16MSB"},     {ASIOSTInt24MSB, "Int24MSB"},     {ASIOSTInt32MSB, "Int32MSB"},
+	{ASIOSTFloat32MSB, "Float32MSB"}, {ASIOSTFloat64MSB, "Float64MSB"}, {ASIOSTInt32MSB16, "Int32MSB16"},
+	{ASIOSTInt32MSB18, "Int32MSB18"}, {ASIOSTInt32MSB20, "Int32MSB20"}, {ASIOSTInt32MSB24, "Int32MSB24"},
+	{ASIOSTInt16LSB, "Int16LSB"},     {ASIOSTInt24LSB, "Int24LSB"},     {ASIOSTInt32LSB, "Int32LSB"},
+	{ASIOSTFloat32LSB, "Float32LSB"}, {ASIOSTFloat64LSB, "Float64LSB"}, {ASIOSTInt32LSB16, "Int32LSB16"},
+	{ASIOSTInt32LSB18, "Int32LSB18"}, {ASIOSTInt32LSB20, "Int32LSB20"}, {ASIOSTInt32LSB24, "Int32LSB24"},
+};
+
+inline const char *asioSampleTypeName(long type)
+{
+	for (const ASIOSampleTypeName &t : asioPcmSampleTypes)
+		if (t.type == type)
+			return t.name;
+	return "unknown";
+}
+
+/* Widest instruction set the dispatchers of asio-convert.hpp pick on this cpu. */
+inline const char *asioIsaName()
+{
+	const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+	return cpu.avx2 ? "avx2" : cpu.ssse3 ? "ssse3" : "sse2";
+}
@@ -0,0 +1,106 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "asio-arena.hpp"
+#include "asio-convert.hpp"
+#include "asio-test.hpp"
+
+/* Stands for the driver buffer descriptors: an odd size, so that the arrays after it need padding. */
+struct ArenaInfo {
+	int32_t isInput;
+	int32_t channel;
+	void *buffers[2];
+	char name[3];
+};
+
+/* Opens and closes a device 10000 times with random channel and buffer counts, laid out as openDevice does. Under
+ * asan, writing each array over its whole length also checks that none of them overflows the block.
+ */
+ASIO_TEST(arena_layout)
+{
+	ASIOBufferArena arena;
+	std::mt19937 rng(5);
+	std::vector<unsigned char> zeros;
+	size_t largest = 0;
+	int misaligned = 0, dirty = 0, overlapping = 0, grown = 0;
+
+	for (int cycle = 0; cycle < 10000; cycle++) {
+		const size_t ins = rng() % 65, outs = rng() % 65, frames = 16 + rng() % 2048;
+		const size_t chans = ins + outs;
+		const size_t bytes = ASIOBufferArena::footprint<ArenaInfo>(chans) +
+				     ASIOBufferArena::footprint<ASIOSampleFormat>(ins) +
+				     ASIOBufferArena::footprint<ASIOSampleFormat>(outs) +
+				     ASIOBufferArena::footprint<float>(chans * frames) +
+				     2 * ASIOBufferArena::footprint<float>(outs * frames);
+		if (cycle % 1000 == 999)
+			arena.release();
+		const size_t before = arena.size();
+		ASIO_CHECK(arena.begin(bytes));
+		// the block only grows, and only when needed
+		grown += arena.size() != (bytes > before ? bytes : before) ? 1 : 0;
+		largest = bytes > largest ? bytes : largest;
+		zeros.resize(largest);
+
+		// the sample formats are default constructed, the rest value initialized: zeroed
+		struct Array {
+			unsigned char *p;
+			size_t bytes;
+			bool zeroed;
+		} arrays[] = {
+			{(unsigned char *)arena.take<ArenaInfo>(chans), chans * sizeof(ArenaInfo), true},
+			{(unsigned char *)arena.take<ASIOSampleFormat>(ins), ins * sizeof(ASIOSampleFormat), false},
+			{(unsigned char *)arena.take<ASIOSampleFormat>(outs), outs * sizeof(ASIOSampleFormat), false},
+			{(unsigned char *)arena.take<float>(chans * frames), chans * frames * sizeof(float), true},
+			{(unsigned char *)arena.take<float>(outs * frames), outs * frames * sizeof(float), true},
+			{(unsigned char *)arena.take<float>(outs * frames), outs * frames * sizeof(float), true},
+		};
+		for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++) {
+			const Array &array = arrays[a];
+			ASIO_CHECK(array.p != nullptr);
+			misaligned += (uintptr_t)array.p % ASIOBufferArena::alignment ? 1 : 0;
+			if (a)
+				overlapping += array.p < arrays[a - 1].p + arrays[a - 1].bytes ? 1 : 0;
+			// whatever the previous layout wrote there
+			if (array.zeroed)
+				dirty += array.bytes && memcmp(array.p, zeros.data(), array.bytes) ? 1 : 0;
+			memset(array.p, 0xA5, array.bytes);
+		}
+		// the layout is full
+		ASIO_CHECK(arena.take<float>(ASIOBufferArena::alignment) == nullptr || arena.size() > bytes);
+	}
+	ASIO_CHECK_MSG(misaligned == 0, "%d arrays not on a cache line", misaligned);
+	ASIO_CHECK_MSG(dirty == 0, "%d arrays not zeroed", dirty);
+	ASIO_CHECK_MSG(overlapping == 0, "%d arrays overlapping", overlapping);
+	ASIO_CHECK_MSG(grown == 0, "%d unexpected sizes", grown);
+	ASIO_CHECK(arena.size() <= largest);
+}
+
+ASIO_TEST(arena_empty)
+{
+	ASIOBufferArena arena;
+	ASIO_CHECK(arena.take<float>(1) == nullptr);
+	ASIO_CHECK(arena.begin(ASIOBufferArena::footprint<float>(1)));
+	ASIO_CHECK(arena.take<float>(0) != nullptr);
+	float *one = arena.take<float>(1);
+	ASIO_CHECK(one != nullptr && *one == 0.0f);
+	ASIO_CHECK(arena.take<float>(1) == nullptr);
+	arena.release();
+	ASIO_CHECK(arena.size() == 0 && arena.take<float>(1) == nullptr);
+}
@@ -0,0 +1,216 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <thread>
+#include "asio-test.hpp"
+#include "fake-driver.hpp"
+
+static const std::string clsid = "{8C5E0F8A-6E1C-4B0F-9A6F-5F0B1C2D3E4F}";
+
+/* What a probe of an 8 in, 2 out interface finds out. */
+static ASIODriverCaps interfaceCaps()
+{
+	ASIODriverCaps caps;
+	caps.numInputs = 8;
+	caps.numOutputs = 2;
+	caps.sampleRates = {44100.0, 48000.0, 96000.0, 88200.5};
+	caps.minBufferSize = 32;
+	caps.maxBufferSize = 2048;
+	caps.preferredBufferSize = 256;
+	caps.bufferGranularity = -1;
+	caps.inputLatency = 301;
+	caps.outputLatency = -7;
+	for (int i = 0; i < 8; i++)
+		caps.inputNames.push_back("Analog " + std::to_string(i + 1));
+	caps.inputNames[2] = "  Mic / Line 3";
+	caps.inputNames[3] = "";
+	caps.outputNames = {"Out L", "Out R"};
+	ASIOCachedClock internal;
+	internal.name = "Internal";
+	internal.current = true;
+	ASIOCachedClock spdif;
+	spdif.index = 1;
+	spdif.channel = -1;
+	spdif.group = 2;
+	spdif.name = "S/PDIF  in";
+	caps.clocks = {internal, spdif};
+	return caps;
+}
+
+static bool sameCaps(const ASIODriverCaps &a, const ASIODriverCaps &b)
+{
+	if (a.clocks.size() != b.clocks.size())
+		return false;
+	for (size_t i = 0; i < a.clocks.size(); i++) {
+		const ASIOCachedClock &x = a.clocks[i], &y = b.clocks[i];
+		if (x.index != y.index || x.channel != y.channel || x.group != y.group || x.current != y.current ||
+		    x.name != y.name)
+			return false;
+	}
+	return a.numInputs == b.numInputs && a.numOutputs == b.numOutputs && a.sampleRates == b.sampleRates &&
+	       a.minBufferSize == b.minBufferSize && a.maxBufferSize == b.maxBufferSize &&
+	       a.preferredBufferSize == b.preferredBufferSize && a.bufferGranularity == b.bufferGranularity &&
+	       a.inputNames == b.inputNames && a.outputNames == b.outputNames && a.inputLatency == b.inputLatency &&
+	       a.outputLatency == b.outputLatency;
+}
+
+/* What a run of obs stores, the next one reads back as it was. */
+ASIO_TEST(caps_round_trip)
+{
+	auto text = std::make_shared<std::string>();
+	const std::string key = ASIOCapsCache::key(clsid, 3);
+	ASIO_CHECK(key == clsid + "-3");
+	const ASIODriverCaps stored = interfaceCaps();
+	{
+		ASIOCapsCache cache(std::make_unique<MemoryCapsFile>(text));
+		ASIODriverCaps caps;
+		ASIO_CHECK(!cache.load(key, caps));
+		ASIO_CHECK(cache.store(key, stored));
+	}
+	ASIO_CHECK(text->compare(0, 12, "asio-caps 1\n") == 0);
+
+	ASIOCapsCache next(std::make_unique<MemoryCapsFile>(text));
+	ASIODriverCaps caps;
+	ASIO_CHECK(next.load(key, caps));
+	ASIO_CHECK(sameCaps(caps, stored));
+
+	// line breaks in a name would split its entry: they are stored as spaces
+	ASIODriverCaps broken = stored;
+	broken.outputNames[1] = "Out\nR\r";
+	ASIO_CHECK(next.store(key, broken));
+	ASIO_CHECK(next.load(key, caps));
+	ASIO_CHECK(caps.outputNames[1] == "Out R ");
+	ASIO_CHECK(caps.inputNames == stored.inputNames);
+
+	// a file edited on windows, with crlf line ends, still reads
+	std::string crlf;
+	for (char c : *text) {
+		if (c == '\n')
+			crlf += '\r';
+		crlf += c;
+	}
+	*text = crlf;
+	ASIO_CHECK(next.load(key, caps) && caps.outputNames[0] == "Out L" && caps.clocks[1].name == "S/PDIF  in");
+}
+
+/* An updated driver, another driver and an older cache file. */
+ASIO_TEST(caps_version_mismatch)
+{
+	auto text = std::make_shared<std::string>();
+	ASIOCapsCache cache(std::make_unique<MemoryCapsFile>(text));
+	ASIODriverCaps caps, other = interfaceCaps();
+	other.numInputs = 2;
+	other.inputNames.resize(2);
+	ASIO_CHECK(cache.store(ASIOCapsCache::key(clsid, 3), interfaceCaps()));
+
+	// the driver was updated: its new version is not cached, the old entry stays
+	ASIO_CHECK(!cache.load(ASIOCapsCache::key(clsid, 4), caps));
+	ASIO_CHECK(cache.store(ASIOCapsCache::key(clsid, 4), other));
+	ASIO_CHECK(cache.load(ASIOCapsCache::key(clsid, 4), caps) && caps.numInputs == 2);
+	ASIO_CHECK(cache.load(ASIOCapsCache::key(clsid, 3), caps) && caps.numInputs == 8);
+
+	// a driver with another class id is another entry
+	const std::string otherKey = ASIOCapsCache::key("{232685C6-6548-49D8-846D-4141A3EF7560}", 3);
+	ASIO_CHECK(!cache.load(otherKey, caps));
+
+	// an entry stored again replaces the previous one
+	ASIO_CHECK(cache.store(ASIOCapsCache::key(clsid, 3), other));
+	ASIO_CHECK(cache.load(ASIOCapsCache::key(clsid, 3), caps) && caps.numInputs == 2);
+
+	// a file in another format is ignored, then rewritten in this one
+	const std::string current = *text;
+	std::string older = current;
+	older.replace(0, 11, "asio-caps 0");
+	*text = older;
+	ASIO_CHECK(!cache.load(ASIOCapsCache::key(clsid, 3), caps));
+	ASIO_CHECK(cache.store(otherKey, other));
+	ASIO_CHECK(cache.load(otherKey, caps));
+	ASIO_CHECK(!cache.load(ASIOCapsCache::key(clsid, 3), caps));
+	ASIO_CHECK(text->compare(0, 12, "asio-caps 1\n") == 0);
+
+	// entries which do not add up, or with an unknown line, are misses
+	*text = current.substr(0, current.find("input Analog 2"));
+	ASIO_CHECK(!cache.load(ASIOCapsCache::key(clsid, 3), caps));
+	*text = current;
+	text->insert(text->find("rates"), "gain 3\n");
+	ASIO_CHECK(!cache.load(ASIOCapsCache::key(clsid, 3), caps));
+	*text = current;
+	text->replace(text->find("channels 2 2"), 12, "channels 2 x");
+	ASIO_CHECK(!cache.load(ASIOCapsCache::key(clsid, 3), caps));
+}
+
+/* The first open probes, the next ones read the cache unless the driver has another number of channels. */
+ASIO_TEST(caps_probe_or_load)
+{
+	auto text = std::make_shared<std::string>();
+	const std::string key = ASIOCapsCache::key(clsid, 3);
+	int probes = 0;
+	bool probeFails = false;
+	auto probe = [&](ASIODriverCaps &caps) {
+		probes++;
+		caps = interfaceCaps();
+		return !probeFails;
+	};
+
+	ASIODriverCaps caps;
+	{
+		ASIOCapsCache cold(std::make_unique<MemoryCapsFile>(text));
+		// a failed probe is not cached
+		probeFails = true;
+		ASIO_CHECK(!cold.probeOrLoad(key, 8, 2, caps, probe));
+		ASIO_CHECK(probes == 1 && text->empty());
+		probeFails = false;
+		ASIO_CHECK(!cold.probeOrLoad(key, 8, 2, caps, probe));
+		ASIO_CHECK(probes == 2 && sameCaps(caps, interfaceCaps()));
+	}
+
+	ASIOCapsCache warm(std::make_unique<MemoryCapsFile>(text));
+	caps = ASIODriverCaps();
+	ASIO_CHECK(warm.probeOrLoad(key, 8, 2, caps, probe));
+	ASIO_CHECK(probes == 2 && sameCaps(caps, interfaceCaps()));
+
+	// the interface now runs with an expansion unit: more inputs, probed again
+	ASIO_CHECK(!warm.probeOrLoad(key, 16, 2, caps, probe));
+	ASIO_CHECK(probes == 3);
+}
+
+/* Several devices open at once, each on its own worker thread. */
+ASIO_TEST(caps_threads)
+{
+	auto text = std::make_shared<std::string>();
+	ASIOCapsCache cache(std::make_unique<MemoryCapsFile>(text));
+	const int devices = 4;
+	std::vector<std::thread> threads;
+	for (int d = 0; d < devices; d++) {
+		threads.emplace_back([&cache, d]() {
+			ASIODriverCaps caps = interfaceCaps();
+			caps.preferredBufferSize = 64 * (d + 1);
+			for (int i = 0; i < 20; i++) {
+				const std::string key = ASIOCapsCache::key(clsid, d);
+				ASIO_CHECK(cache.store(key, caps));
+				ASIODriverCaps read;
+				ASIO_CHECK(cache.load(key, read));
+				ASIO_CHECK(read.preferredBufferSize == caps.preferredBufferSize);
+			}
+		});
+	}
+	for (std::thread &t : threads)
+		t.join();
+	ASIODriverCaps caps;
+	for (int d = 0; d < devices; d++)
+		ASIO_CHECK(cache.load(ASIOCapsCache::key(clsid, d), caps) && caps.preferredBufferSize == 64 * (d + 1));
+}
@@ -0,0 +1,380 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Every simd kernel of asio-convert.hpp against its scalar reference, bit for bit.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <functional>
+#include <limits>
+#include <random>
+#include <vector>
+#include "asio-convert.hpp"
+#include "asio-test.hpp"
+
+/* Longest period swept: covers every simd body and tail split. */
+static const int sweepLength = 67;
+
+/* Fills n device samples of size bytes, from random bits or from byte patterns hitting the extremes. */
+typedef std::function<void(char *dest, int n, int bytes, std::mt19937 &rng)> DeviceFill;
+
+static void randomBytes(char *dest, int n, int bytes, std::mt19937 &rng)
+{
+	for (int i = 0; i < n * bytes; i++)
+		dest[i] = (char)rng();
+}
+
+/* 0, -1, 1, max and min in either byte order. 4-byte containers get them on 16, 24 or 32 bits, for the samples
+ * held in their least significant bits, with random padding above.
+ */
+static void extremeBytes(char *dest, int n, int bytes, std::mt19937 &rng)
+{
+	for (int i = 0; i < n; i++) {
+		const int kind = rng() % 5;
+		const bool msbFirst = rng() & 1;
+		const int width = bytes == 4 ? 2 + rng() % 3 : bytes;
+		char *p = dest + i * bytes;
+		for (int b = 0; b < bytes; b++) {
+			// b counts from the least significant byte
+			const bool top = b == width - 1;
+			unsigned char v = (unsigned char)rng();
+			if (b < width) {
+				const unsigned char values[] = {0x00, 0xFF, (unsigned char)(b == 0),
+								(unsigned char)(top ? 0x7F : 0xFF),
+								(unsigned char)(top ? 0x80 : 0x00)};
+				v = values[kind];
+			}
+			p[msbFirst ? bytes - 1 - b : b] = (char)v;
+		}
+	}
+}
+
+/* Runs kernel and reference over every length up to sweepLength and 4 source misalignments; the floats must be
+ * identical. Each source buffer ends exactly with its last sample so that the address sanitizer catches over-reads.
+ */
+static void sweepToFloat(const char *name, ASIOConvertToFloatFn kernel, ASIOConvertToFloatFn reference, int bytes,
+			 const DeviceFill &fill)
+{
+	std::mt19937 rng(7);
+
+	for (int n = 0; n <= sweepLength; n++) {
+		for (int offset = 0; offset < 4; offset++) {
+			std::vector<char> src(offset + (size_t)n * bytes);
+			fill(src.data() + offset, n, bytes, rng);
+			std::vector<float> expected(n + 1, -2.0f), actual(n + 1, -2.0f);
+			reference(src.data() + offset, expected.data(), n);
+			kernel(src.data() + offset, actual.data(), n);
+			ASIO_CHECK_MSG(!memcmp(expected.data(), actual.data(), (n + 1) * sizeof(float)),
+				       "%s, %d samples, offset %d", name, n, offset);
+		}
+	}
+}
+
+static void sweepToFloat(const char *name, ASIOConvertToFloatFn kernel, ASIOConvertToFloatFn reference, int bytes)
+{
+	sweepToFloat(name, kernel, reference, bytes, randomBytes);
+	sweepToFloat(name, kernel, reference, bytes, extremeBytes);
+}
+
+/* Doubles in [-1, 1] mixed with the values narrowing has to get right: overflow to infinity, denormals, nan. */
+static DeviceFill doubles(bool littleEndian)
+{
+	return [littleEndian](char *dest, int n, int bytes, std::mt19937 &rng) {
+		static const double special[] = {0.0, -0.0, 1.0, -1.0, 1e300, -1e300, 1e-310, 3.4028235677973366e38,
+						 std::numeric_limits<double>::infinity(),
+						 std::numeric_limits<double>::quiet_NaN()};
+		std::uniform_real_distribution<double> dist(-1.0, 1.0);
+		for (int i = 0; i < n; i++) {
+			const double d = rng() % 4 ? dist(rng) : special[rng() % 10];
+			uint64_t v;
+			memcpy(&v, &d, sizeof(v));
+			if (!littleEndian)
+				v = ByteOrder::swap(v);
+			memcpy(dest + i * bytes, &v, sizeof(v));
+		}
+	};
+}
+
+/* Floats in [-1.25, 1.25], at the rounding ties of a bits wide sample, and the values to clip: nan, infinities. */
+static void floats(float *dest, int n, int bits, std::mt19937 &rng)
+{
+	const float maxVal = (float)((1u << (bits - 1)) - 1);
+	const float special[] = {0.0f, -0.0f, 1.0f, -1.0f, 1.0000001f, -1.0000001f, 2.0f, -2.0f, 1e-40f,
+				 std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+				 std::numeric_limits<float>::quiet_NaN()};
+	std::uniform_real_distribution<float> dist(-1.25f, 1.25f);
+	for (int i = 0; i < n; i++) {
+		switch (rng() % 4) {
+		case 0:
+			dest[i] = special[rng() % 12];
+			break;
+		case 1:
+			dest[i] = ((float)(int)(rng() % 2001 - 1000) + 0.5f) / maxVal;
+			break;
+		default:
+			dest[i] = dist(rng);
+			break;
+		}
+	}
+}
+
+/* Same as sweepToFloat the other way; each destination ends exactly with its last sample. */
+static void sweepFromFloat(const char *name, ASIOConvertFromFloatFn kernel, ASIOConvertFromFloatFn reference,
+			   int bytes, int bits)
+{
+	std::mt19937 rng(11);
+
+	for (int n = 0; n <= sweepLength; n++) {
+		for (int offset = 0; offset < 4; offset++) {
+			std::vector<float> src(offset + (size_t)n);
+			floats(src.data() + offset, n, bits, rng);
+			std::vector<char> expected(offset + (size_t)n * bytes, 0x55), actual(expected);
+			reference(src.data() + offset, expected.data() + offset, n);
+			kernel(src.data() + offset, actual.data() + offset, n);
+			ASIO_CHECK_MSG(expected == actual, "%s, %d samples, offset %d", name, n, offset);
+		}
+	}
+}
+
+struct SampleConvertTest {
+	template<int stride, bool littleEndian> static void int24()
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+		const ASIOConvertToFloatFn reference = SampleConvert::int24ToFloatScalar<stride, littleEndian>;
+
+		sweepToFloat("int24 sse2", SampleConvert::int24ToFloatSSE2<stride, littleEndian>, reference, stride);
+		if (cpu.ssse3)
+			sweepToFloat("int24 ssse3", SampleConvert::int24ToFloatSSSE3<stride, littleEndian>, reference,
+				     stride);
+		if (cpu.avx2)
+			sweepToFloat("int24 avx2", SampleConvert::int24ToFloatAVX2<stride, littleEndian>, reference,
+				     stride);
+		sweepToFloat("int24 dispatch", SampleConvert::int24ToFloat(stride, littleEndian), reference, stride);
+	}
+
+	template<bool littleEndian> static void int16()
+	{
+		const ASIOConvertToFloatFn reference = SampleConvert::intToFloat<2, 16, littleEndian>;
+
+		sweepToFloat("int16 sse2", SampleConvert::int16ToFloatSSE2<littleEndian>, reference, 2);
+		if (ASIOCpuFeatures::get().avx2)
+			sweepToFloat("int16 avx2", SampleConvert::int16ToFloatAVX2<littleEndian>, reference, 2);
+		sweepToFloat("int16 dispatch", SampleConvert::int16ToFloat(littleEndian), reference, 2);
+	}
+
+	/* 32-bit containers holding 16, 18, 20 or 32 significant bits */
+	template<int bits, bool littleEndian> static void int32()
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+		const ASIOConvertToFloatFn reference = SampleConvert::intToFloat<4, bits, littleEndian>;
+
+		sweepToFloat("int32 sse2", SampleConvert::int32ToFloatSSE2<bits, littleEndian>, reference, 4);
+		if (!littleEndian && cpu.ssse3)
+			sweepToFloat("int32 msb ssse3", SampleConvert::int32ToFloatSSSE3<bits>, reference, 4);
+		if (cpu.avx2)
+			sweepToFloat("int32 avx2", SampleConvert::int32ToFloatAVX2<bits, littleEndian>, reference, 4);
+		sweepToFloat("int32 dispatch", SampleConvert::int32ToFloat<bits>(littleEndian), reference, 4);
+	}
+
+	template<int bytes, int bits, bool littleEndian, ASIORounding rounding> static void toInt()
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+		const ASIOConvertFromFloatFn reference =
+			SampleConvert::floatToIntScalar<bytes, bits, littleEndian, rounding, false>;
+
+		sweepFromFloat("to int sse2",
+			       SampleConvert::floatToIntSSE2<bytes, bits, littleEndian, rounding, false>, reference,
+			       bytes, bits);
+		if (bytes == 3 && cpu.ssse3)
+			sweepFromFloat("to int24 ssse3",
+				       SampleConvert::floatToInt24SSSE3<littleEndian, rounding, false>, reference,
+				       bytes, bits);
+		if (cpu.avx2)
+			sweepFromFloat("to int avx2",
+				       SampleConvert::floatToIntAVX2<bytes, bits, littleEndian, rounding, false>,
+				       reference, bytes, bits);
+		sweepFromFloat("to int dispatch",
+			       SampleConvert::floatToInt<bytes, bits, littleEndian>(rounding, false), reference, bytes,
+			       bits);
+	}
+
+	template<int bytes, int bits, bool littleEndian> static void toInt()
+	{
+		toInt<bytes, bits, littleEndian, ASIORounding::nearest>();
+		toInt<bytes, bits, littleEndian, ASIORounding::truncate>();
+	}
+
+	/* What the reference writes for one float. */
+	template<int bytes, int bits, ASIORounding rounding> static int32_t quantize(float f)
+	{
+		char out[bytes];
+		SampleConvert::floatToIntScalar<bytes, bits, true, rounding, false>(&f, out, 1);
+		int32_t v = SampleConvert::readInt<bytes, true>(out);
+		return bits < bytes * 8 ? SampleConvert::signExtend<bits>(v) : v;
+	}
+
+	/* The dithered kernels stay within a step of the plain rounding and average out to the input. */
+	template<int bytes, int bits> static void dither(ASIOConvertFromFloatFn kernel, const char *name)
+	{
+		const int n = 4096 + 3;
+		const float maxVal = (float)((1u << (bits - 1)) - 1);
+		std::vector<float> src(n);
+		std::vector<char> plain((size_t)n * bytes), dithered((size_t)n * bytes);
+		std::mt19937 rng(5);
+
+		floats(src.data(), n, bits, rng);
+		SampleConvert::floatToIntScalar<bytes, bits, true>(src.data(), plain.data(), n);
+		kernel(src.data(), dithered.data(), n);
+		for (int i = 0; i < n; i++) {
+			const int32_t a = SampleConvert::readInt<bytes, true>(&plain[(size_t)i * bytes]);
+			const int32_t b = SampleConvert::readInt<bytes, true>(&dithered[(size_t)i * bytes]);
+			// 24-bit samples are dithered in float, whose rounding near full scale can add a step
+			const int32_t tolerance = bits > 16 ? 2 : 1;
+			ASIO_CHECK_MSG(std::abs(a - b) <= tolerance, "%s, sample %d: %f -> %d, dithered %d", name, i,
+				       src[i], a, b);
+		}
+
+		// a constant 0.3 step input
+		std::fill(src.begin(), src.end(), 0.3f / maxVal);
+		kernel(src.data(), dithered.data(), n);
+		double sum = 0.0;
+		for (int i = 0; i < n; i++)
+			sum += SampleConvert::readInt<bytes, true>(&dithered[(size_t)i * bytes]);
+		ASIO_CHECK_MSG(std::fabs(sum / n - 0.3) < 0.05, "%s: mean %f", name, sum / n);
+	}
+
+	static void float64()
+	{
+		const ASIOCpuFeatures &cpu = ASIOCpuFeatures::get();
+		const DeviceFill lsb = doubles(true), msb = doubles(false);
+
+		sweepToFloat("float64 lsb sse2", SampleConvert::float64ToFloatSSE2,
+			     SampleConvert::float64ToFloatScalar<true>, 8, lsb);
+		if (cpu.avx)
+			sweepToFloat("float64 lsb avx", SampleConvert::float64ToFloatAVX,
+				     SampleConvert::float64ToFloatScalar<true>, 8, lsb);
+		if (cpu.ssse3)
+			sweepToFloat("float64 msb ssse3", SampleConvert::float64ToFloatSSSE3,
+				     SampleConvert::float64ToFloatScalar<false>, 8, msb);
+		if (cpu.avx2)
+			sweepToFloat("float64 msb avx2", SampleConvert::float64MSBToFloatAVX2,
+				     SampleConvert::float64ToFloatScalar<false>, 8, msb);
+		sweepToFloat("float64 lsb dispatch", SampleConvert::float64ToFloat(true),
+			     SampleConvert::float64ToFloatScalar<true>, 8, lsb);
+		sweepToFloat("float64 msb dispatch", SampleConvert::float64ToFloat(false),
+			     SampleConvert::float64ToFloatScalar<false>, 8, msb);
+
+		// the reference itself: a double at the float precision narrows exactly, and back
+		const float values[] = {0.0f, 1.0f, -1.0f, 0.5f, -0.25f, 1e-20f, 3.0e38f};
+		for (bool littleEndian : {true, false}) {
+			char device[sizeof(values) * 2];
+			float back[7];
+			if (littleEndian) {
+				SampleConvert::floatToFloat64<true>(values, device, 7);
+				SampleConvert::float64ToFloatScalar<true>(device, back, 7);
+			} else {
+				SampleConvert::floatToFloat64<false>(values, device, 7);
+				SampleConvert::float64ToFloatScalar<false>(device, back, 7);
+			}
+			ASIO_CHECK(!memcmp(values, back, sizeof(values)));
+		}
+	}
+};
+
+/* Int24LSB/MSB and Int32LSB24/MSB24 */
+ASIO_TEST(convert_int24)
+{
+	SampleConvertTest::int24<3, true>();
+	SampleConvertTest::int24<3, false>();
+	SampleConvertTest::int24<4, true>();
+	SampleConvertTest::int24<4, false>();
+}
+
+/* Int16LSB/MSB, Int32LSB/MSB and Int32LSB16/18/20 and their MSB variants */
+ASIO_TEST(convert_int16_int32)
+{
+	SampleConvertTest::int16<true>();
+	SampleConvertTest::int16<false>();
+	SampleConvertTest::int32<16, true>();
+	SampleConvertTest::int32<16, false>();
+	SampleConvertTest::int32<18, true>();
+	SampleConvertTest::int32<18, false>();
+	SampleConvertTest::int32<20, true>();
+	SampleConvertTest::int32<20, false>();
+	SampleConvertTest::int32<32, true>();
+	SampleConvertTest::int32<32, false>();
+}
+
+/* Every integer output container, both byte orders, both roundings, without dither. */
+ASIO_TEST(convert_to_int)
+{
+	SampleConvertTest::toInt<2, 16, true>();
+	SampleConvertTest::toInt<2, 16, false>();
+	SampleConvertTest::toInt<3, 24, true>();
+	SampleConvertTest::toInt<3, 24, false>();
+	SampleConvertTest::toInt<4, 32, true>();
+	SampleConvertTest::toInt<4, 32, false>();
+	SampleConvertTest::toInt<4, 16, true>();
+	SampleConvertTest::toInt<4, 18, false>();
+	SampleConvertTest::toInt<4, 20, true>();
+	SampleConvertTest::toInt<4, 24, false>();
+}
+
+/* Clipping and rounding of the reference, which the kernels match bit for bit. */
+ASIO_TEST(convert_to_int_boundaries)
+{
+	const ASIORounding nearest = ASIORounding::nearest, truncate = ASIORounding::truncate;
+	const float nan = std::numeric_limits<float>::quiet_NaN(), inf = std::numeric_limits<float>::infinity();
+
+	// clipped symmetrically to +-max, nan to +max
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(1.0f)) == 32767);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(1.5f)) == 32767);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(-1.0f)) == -32767);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(-inf)) == -32767);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(nan)) == 32767);
+	ASIO_CHECK((SampleConvertTest::quantize<3, 24, nearest>(1.0f)) == 8388607);
+	ASIO_CHECK((SampleConvertTest::quantize<3, 24, nearest>(-2.0f)) == -8388607);
+	ASIO_CHECK((SampleConvertTest::quantize<4, 32, nearest>(1.0f)) == 2147483647);
+	ASIO_CHECK((SampleConvertTest::quantize<4, 32, nearest>(-1.0f)) == -2147483647);
+	ASIO_CHECK((SampleConvertTest::quantize<4, 32, nearest>(inf)) == 2147483647);
+	ASIO_CHECK((SampleConvertTest::quantize<4, 20, nearest>(1.0f)) == 524287);
+	ASIO_CHECK((SampleConvertTest::quantize<4, 20, nearest>(-1.0f)) == -524287);
+
+	// half to even, or toward zero
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(0.5f / 32767)) == 0);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(1.5f / 32767)) == 2);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, nearest>(-2.5f / 32767)) == -2);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, truncate>(1.75f / 32767)) == 1);
+	ASIO_CHECK((SampleConvertTest::quantize<2, 16, truncate>(-1.75f / 32767)) == -1);
+	ASIO_CHECK((SampleConvertTest::quantize<3, 24, truncate>(0.999999f)) == 8388598);
+	ASIO_CHECK((SampleConvertTest::quantize<4, 32, truncate>(-0.5f)) == -1073741823);
+}
+
+/* TPDF dither on 16 and 24-bit output. */
+ASIO_TEST(convert_to_int_dither)
+{
+	SampleConvertTest::dither<2, 16>(SampleConvert::floatToInt<2, 16, true>(ASIORounding::nearest, true),
+					 "int16 dispatch");
+	SampleConvertTest::dither<3, 24>(SampleConvert::floatToInt<3, 24, true>(ASIORounding::nearest, true),
+					 "int24 dispatch");
+	SampleConvertTest::dither<2, 16>(SampleConvert::floatToIntScalar<2, 16, true, ASIORounding::nearest, true>,
+					 "int16 scalar");
+}
+
+/* Float64LSB/MSB */
+ASIO_TEST(convert_float64)
+{
+	SampleConvertTest::float64();
+}
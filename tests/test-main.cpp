@@ -0,0 +1,52 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <cstring>
+#include "asio-test.hpp"
+
+int asioTestFailures = 0;
+
+std::vector<ASIOTest> &asioTests()
+{
+	static std::vector<ASIOTest> tests;
+	return tests;
+}
+
+/* asio-tests [name prefix]: runs the matching tests, returns 1 if any check failed. */
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : "";
+	int count = 0, failed = 0;
+
+	for (const ASIOTest &test : asioTests()) {
+		if (strncmp(test.name, filter, strlen(filter)) != 0)
+			continue;
+		const int before = asioTestFailures;
+		test.run();
+		const bool ok = asioTestFailures == before;
+		printf("%s %s\n", ok ? "pass" : "FAIL", test.name);
+		fflush(stdout);
+		count++;
+		failed += ok ? 0 : 1;
+	}
+	if (!count) {
+		fprintf(stderr, "no test matches \"%s\"\n", filter);
+		return 1;
+	}
+	printf("%d of %d tests passed\n", count - failed, count);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "asio-meter.hpp"
+#include "asio-test.hpp"
+
+ASIO_TEST(meter_levels)
+{
+	ASIOLevelMeter meter;
+	meter.reset(4);
+
+	for (int n : {1, 7, 64, 67}) {
+		std::vector<float> square(n);
+		for (int i = 0; i < n; i++)
+			square[i] = i % 2 ? -0.5f : 0.5f;
+		square[n / 2] = -0.75f;
+		meter.measure(0, square.data(), n);
+		float peak = 0.0f, rms = 0.0f;
+		ASIO_CHECK(meter.read(0, peak, rms));
+		ASIO_CHECK_MSG(peak == 0.75f, "%d samples: peak %f", n, peak);
+		const float expected = std::sqrt((0.25f * (n - 1) + 0.5625f) / n);
+		ASIO_CHECK_MSG(std::fabs(rms - expected) < 1e-5f, "%d samples: rms %f", n, rms);
+		// the peak holds until it is read
+		ASIO_CHECK(meter.read(0, peak, rms) && peak == 0.0f);
+	}
+	meter.silence(1);
+	float peak = 0.0f, rms = 0.0f;
+	ASIO_CHECK(meter.read(1, peak, rms) && peak == 0.0f && rms == 0.0f);
+	ASIO_CHECK(!meter.read(2, peak, rms) && !meter.read(9, peak, rms));
+	const std::vector<float> half(16, 0.5f);
+	meter.measure(0, half.data(), 16);
+	ASIO_CHECK(meter.summary() == "1: -6.0/-6.0 | 2: -inf/-inf dBFS (peak/rms)");
+}
+
+/* The stats of a source read the levels while the device reopens with another channel count. */
+ASIO_TEST(meter_reset_while_read)
+{
+	ASIOLevelMeter meter;
+	std::atomic<bool> done{false};
+	meter.reset(2);
+
+	std::thread reader([&]() {
+		while (!done.load()) {
+			meter.summary();
+			std::this_thread::yield();
+		}
+	});
+	const float samples[64] = {0.5f};
+	for (int i = 0; i < 2048; i++) {
+		const int channels = 1 + i % 32;
+		meter.reset(channels);
+		for (int c = 0; c < channels; c++)
+			meter.measure(c, samples, 64);
+	}
+	done = true;
+	reader.join();
+	ASIO_CHECK(meter.summary().find("32: ") != std::string::npos);
+}
@@ -0,0 +1,239 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cmath>
+#include "asio-mix.hpp"
+#include "asio-test.hpp"
+
+ASIO_TEST(mix_parse)
+{
+	ASIOMixMatrix matrix;
+	std::string error;
+
+	ASIO_CHECK(matrix.parse("# comment\n1 = 1 + 2*0.5\n2 = 3*-6dB\n", 4, error));
+	ASIO_CHECK(matrix.terms.size() == 3);
+	ASIO_CHECK(matrix.mixed[0] && matrix.mixed[1] && !matrix.mixed[2]);
+	ASIO_CHECK(matrix.terms[1].output == 0 && matrix.terms[1].input == 1 && matrix.terms[1].gain == 0.5f);
+	ASIO_CHECK(std::fabs(matrix.terms[2].gain - 0.501f) < 0.001f);
+
+	// bad lines are reported and skipped, the others kept
+	const uint32_t generation = matrix.generation;
+	ASIO_CHECK(!matrix.parse("1 = 5\n2 = 2\n9 = 1\n", 4, error));
+	ASIO_CHECK(error == "line 1: 1 = 5");
+	ASIO_CHECK(matrix.terms.size() == 1 && matrix.mixed[1] && !matrix.mixed[0]);
+	ASIO_CHECK(matrix.generation != generation);
+}
+
+/* Constant inputs: asio input i is worth i + 1, so the output tells which gains were applied. */
+struct MixBench {
+	static constexpr int inputs = 4, frames = 64;
+	std::vector<float> planes[inputs];
+	const float *channels[inputs];
+	int route[ASIOMixMatrix::maxOutputs];
+	ASIOMixer mixer;
+	ASIOMixMatrix matrix;
+	bool removed = false; // the source has no matrix anymore
+	float previous = NAN; // last sample played
+	float maxJump = 0.0f; // largest step between two samples played, across periods
+
+	MixBench()
+	{
+		for (int i = 0; i < inputs; i++) {
+			planes[i].assign(frames, (float)(i + 1));
+			channels[i] = planes[i].data();
+		}
+		for (int n = 0; n < ASIOMixMatrix::maxOutputs; n++)
+			route[n] = n < inputs ? n : -1;
+	}
+
+	void set(const char *text)
+	{
+		std::string error;
+		matrix.parse(text, inputs, error);
+		removed = false;
+	}
+
+	/* What obs gets on channel n, as the delivery thread picks it. */
+	float played(int n, int k)
+	{
+		if (mixer.mixes(n))
+			return mixer.output(n)[k];
+		return route[n] >= 0 ? channels[route[n]][k] : 0.0f;
+	}
+
+	/* Mixes periods at 48 kHz, returns the first and last sample of obs channel n in the first and last period. */
+	void run(int periods, int n, float &first, float &last)
+	{
+		for (int p = 0; p < periods; p++) {
+			mixer.process(removed ? nullptr : &matrix, route, channels, inputs, frames, 48000.0);
+			if (!p)
+				first = played(n, 0);
+			for (int k = 0; k < frames; k++) {
+				const float sample = played(n, k);
+				if (!std::isnan(previous))
+					maxJump = std::max(maxJump, std::fabs(sample - previous));
+				previous = sample;
+			}
+		}
+		last = played(n, frames - 1);
+	}
+
+	/* Goes on until the mixer is idle; returns the number of periods it took. */
+	int runOut(int n, float &last)
+	{
+		float first;
+		int periods = 0;
+		while (mixer.active() && periods < 1000) {
+			run(1, n, first, last);
+			periods++;
+		}
+		return periods;
+	}
+};
+
+/* An obs channel which starts being mixed continues from the input it was routed from, then ramps. */
+ASIO_TEST(mix_fade_from_route)
+{
+	MixBench bench;
+	float first, last;
+
+	// channel 1 played asio input 1 (worth 1.0) and now plays input 2 (worth 2.0)
+	bench.set("1 = 2");
+	bench.run(1, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(first - 1.0f) < 0.01f, "starts from %f", first);
+	ASIO_CHECK_MSG(last > first && last < 2.0f, "ramps to %f", last);
+	// the ramp lasts 20 ms: 960 frames
+	bench.run(15, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(last - 2.0f) < 1e-5f, "ends at %f", last);
+
+	// back to the plain routes, then a matrix keeping the routed input at unity gain
+	bench.removed = true;
+	bench.runOut(0, last);
+	bench.run(1, 0, first, last);
+	ASIO_CHECK(!bench.mixer.mixes(0) && last == 1.0f);
+	bench.set("1 = 1 + 3*0.5");
+	bench.run(1, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(first - 1.0f) < 0.01f, "starts from %f", first);
+	bench.run(15, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(last - 2.5f) < 1e-5f, "ends at %f", last);
+
+	// a matrix replacing another one ramps from the gains of the previous one
+	bench.set("1 = 4*0.25");
+	bench.run(1, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(first - 2.5f) < 0.01f, "starts from %f", first);
+	bench.run(15, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(last - 1.0f) < 1e-5f, "ends at %f", last);
+	ASIO_CHECK_MSG(bench.maxJump < 0.01f, "jumps by %f", bench.maxJump);
+}
+
+/* A channel which was routed to no input was silent: its mix fades in. */
+ASIO_TEST(mix_fade_from_silence)
+{
+	MixBench bench;
+	float first, last;
+
+	bench.route[0] = -1;
+	bench.set("1 = 2");
+	bench.run(1, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(first) < 0.01f, "starts from %f", first);
+	bench.run(15, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(last - 2.0f) < 1e-5f, "ends at %f", last);
+
+	// channel 2 was routed from input 2 (worth 2.0): input 1 at twice the gain fades in as input 2 fades out
+	bench.set("2 = 1*2");
+	bench.run(16, 1, first, last);
+	ASIO_CHECK_MSG(std::fabs(first - 2.0f) < 0.01f && std::fabs(last - 2.0f) < 1e-5f, "%f to %f", first, last);
+}
+
+/* Removing the matrix of a source, or a line of it, fades the mixed channel back to its route. */
+ASIO_TEST(mix_fade_out)
+{
+	MixBench bench;
+	float first, last;
+
+	bench.set("1 = 2\n2 = 1*2 + 3");
+	bench.run(16, 0, first, last);
+	ASIO_CHECK(std::fabs(last - 2.0f) < 1e-5f);
+
+	// the line of channel 1 is removed: it ramps from input 2 back to input 1, then plays its route again
+	bench.set("2 = 1*2 + 3");
+	bench.run(1, 0, first, last);
+	ASIO_CHECK(bench.mixer.mixes(0));
+	ASIO_CHECK_MSG(std::fabs(first - 2.0f) < 0.01f && last < first && last > 1.0f, "%f to %f", first, last);
+	bench.run(15, 0, first, last);
+	ASIO_CHECK_MSG(last == 1.0f, "ends at %f", last);
+	bench.run(1, 0, first, last);
+	ASIO_CHECK(!bench.mixer.mixes(0) && bench.mixer.mixes(1));
+	ASIO_CHECK_MSG(bench.maxJump < 0.01f, "jumps by %f", bench.maxJump);
+
+	// the whole matrix is removed: channel 2 fades from 5.0 back to input 2
+	bench.previous = NAN;
+	bench.run(1, 1, first, last);
+	ASIO_CHECK(std::fabs(last - 5.0f) < 1e-5f);
+	bench.removed = true;
+	const int periods = bench.runOut(1, last);
+	ASIO_CHECK_MSG(periods == 15, "faded out in %d periods", periods);
+	ASIO_CHECK_MSG(std::fabs(last - 2.0f) < 0.01f, "ends at %f", last);
+	ASIO_CHECK(!bench.mixer.active());
+	bench.run(1, 1, first, last);
+	ASIO_CHECK(!bench.mixer.mixes(1) && last == 2.0f);
+	ASIO_CHECK_MSG(bench.maxJump < 0.01f, "jumps by %f", bench.maxJump);
+
+	// a channel routed to no input fades out to silence
+	bench.route[2] = -1;
+	bench.previous = NAN;
+	bench.set("3 = 4");
+	bench.run(16, 2, first, last);
+	ASIO_CHECK(std::fabs(last - 4.0f) < 1e-5f);
+	bench.removed = true;
+	bench.runOut(2, last);
+	bench.run(1, 2, first, last);
+	ASIO_CHECK(last == 0.0f && !bench.mixer.mixes(2));
+	ASIO_CHECK_MSG(bench.maxJump < 0.01f, "jumps by %f", bench.maxJump);
+}
+
+/* bypass() fades out like a removed matrix; a matrix set again midway ramps from where the fade is. */
+ASIO_TEST(mix_bypass)
+{
+	MixBench bench;
+	float first, last;
+
+	bench.set("1 = 2");
+	bench.run(16, 0, first, last);
+	bench.mixer.bypass(bench.route, 48000.0);
+	ASIO_CHECK(bench.mixer.active());
+	bench.removed = true;
+	bench.run(1, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(first - 2.0f) < 0.01f && last < first, "%f to %f", first, last);
+
+	// halfway back to input 1, channel 1 is mixed from input 3 again: no jump, and no second unity term
+	bench.run(6, 0, first, last);
+	const float midway = last;
+	bench.set("1 = 3");
+	bench.run(1, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(first - midway) < 0.01f && last > first, "%f, then %f to %f", midway, first, last);
+	bench.run(15, 0, first, last);
+	ASIO_CHECK_MSG(std::fabs(last - 3.0f) < 1e-5f, "ends at %f", last);
+	ASIO_CHECK_MSG(bench.maxJump < 0.01f, "jumps by %f", bench.maxJump);
+
+	// without a matrix playing, bypass() does nothing
+	bench.removed = true;
+	bench.runOut(0, last);
+	bench.mixer.bypass(bench.route, 48000.0);
+	ASIO_CHECK(!bench.mixer.active());
+}
@@ -0,0 +1,188 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <cmath>
+#include "asio-packet.hpp"
+#include "asio-test.hpp"
+
+/* Stereo periods numbering their frames: channel 0 holds the frame number, channel 1 its opposite. */
+struct NumberedPeriods {
+	double rate = 48000.0;
+	uint64_t start = 1000000000; // stamp of frame 0
+	int64_t position = 0;
+	std::vector<float> left, right;
+
+	void fill(int frames)
+	{
+		left.resize(frames);
+		right.resize(frames);
+		for (int n = 0; n < frames; n++) {
+			left[n] = (float)(position + n);
+			right[n] = -(float)(position + n);
+		}
+	}
+
+	uint64_t stampOf(int64_t frame) const { return start + (uint64_t)std::llround(frame * 1e9 / rate); }
+
+	/* Pushes the next period and collects the packets it completes. */
+	void push(ASIOPacketizer &packetizer, int frames, std::vector<ASIOPacket> &out, std::vector<float> &samples)
+	{
+		fill(frames);
+		const float *channels[2] = {left.data(), right.data()};
+		packetizer.push(channels, frames, stampOf(position), rate);
+		position += frames;
+		while (const ASIOPacket *packet = packetizer.pop()) {
+			out.push_back(*packet);
+			// the packet is only valid until the next pop()
+			samples.insert(samples.end(), packet->channels[0], packet->channels[0] + packet->frames);
+			ASIO_CHECK(packet->channels[1] && packet->channels[1][0] == -packet->channels[0][0]);
+		}
+	}
+};
+
+/* Each packet starts at the frame following the previous one, and is stamped with the time of its first frame. */
+static void checkContinuous(const NumberedPeriods &src, const std::vector<ASIOPacket> &packets,
+			    const std::vector<float> &samples, int64_t first = 0)
+{
+	int64_t frame = first;
+	size_t at = 0;
+	int wrong = 0;
+	for (const ASIOPacket &packet : packets) {
+		const double err = (double)packet.timestamp - (double)src.stampOf(frame);
+		if (samples[at] != (float)frame || std::fabs(err) > 1.0)
+			wrong++;
+		for (int n = 0; n < packet.frames; n++)
+			wrong += samples[at + n] != (float)(frame + n) ? 1 : 0;
+		frame += packet.frames;
+		at += packet.frames;
+	}
+	ASIO_CHECK_MSG(wrong == 0, "%d frames or stamps out of place", wrong);
+}
+
+/* 32 frame periods grouped in 10 ms packets: 15 periods per packet. */
+ASIO_TEST(packet_coalesce)
+{
+	ASIOPacketizer packetizer;
+	packetizer.reset(2, 480);
+	NumberedPeriods src;
+	std::vector<ASIOPacket> packets;
+	std::vector<float> samples;
+	for (int i = 0; i < 150; i++) {
+		src.push(packetizer, 32, packets, samples);
+		ASIO_CHECK((int)packets.size() == (i + 1) / 15);
+	}
+	for (const ASIOPacket &packet : packets)
+		ASIO_CHECK(packet.frames == 480);
+	checkContinuous(src, packets, samples);
+}
+
+/* 2048 frame periods cut in 480 frame packets, stamped in between the period stamps. */
+ASIO_TEST(packet_split)
+{
+	ASIOPacketizer packetizer;
+	packetizer.reset(2, 480);
+	NumberedPeriods src;
+	std::vector<ASIOPacket> packets;
+	std::vector<float> samples;
+	src.push(packetizer, 2048, packets, samples);
+	// 4 packets, 128 frames kept for the next period
+	ASIO_CHECK(packets.size() == 4);
+	for (int i = 0; i < 14; i++)
+		src.push(packetizer, 2048, packets, samples);
+	ASIO_CHECK(packets.size() == 15 * 2048 / 480);
+	for (const ASIOPacket &packet : packets)
+		ASIO_CHECK(packet.frames == 480);
+	checkContinuous(src, packets, samples);
+
+	// without a packet size the periods go through as they are, without a copy
+	packetizer.reset(2, 0);
+	src.fill(2048);
+	const float *channels[2] = {src.left.data(), src.right.data()};
+	packetizer.push(channels, 2048, 5, 48000.0);
+	const ASIOPacket *packet = packetizer.pop();
+	ASIO_CHECK(packet && packet->frames == 2048 && packet->timestamp == 5 && packet->channels[0] == channels[0]);
+	ASIO_CHECK(!packetizer.pop());
+}
+
+/* The device reopened at another rate: the frames pending at the old rate go out first, on their own. */
+ASIO_TEST(packet_rate_change)
+{
+	ASIOPacketizer packetizer;
+	packetizer.reset(2, 480);
+	NumberedPeriods src;
+	std::vector<ASIOPacket> packets;
+	std::vector<float> samples;
+	for (int i = 0; i < 20; i++)
+		src.push(packetizer, 64, packets, samples);
+	// 1280 frames: 2 packets and 320 frames pending
+	ASIO_CHECK(packets.size() == 2);
+	checkContinuous(src, packets, samples);
+
+	// the rate changes at frame 1280, stamped on its own time line from then on
+	const uint64_t changedAt = src.stampOf(src.position);
+	src.rate = 96000.0;
+	src.start = changedAt - (uint64_t)std::llround(src.position * 1e9 / src.rate);
+	packets.clear();
+	samples.clear();
+	src.push(packetizer, 64, packets, samples);
+	ASIO_CHECK(packets.size() == 1 && packets[0].frames == 320 && samples[0] == 960.0f);
+	ASIO_CHECK(packets[0].timestamp == 1000000000 + 20000000); // frame 960 at 48 kHz
+	for (int i = 0; i < 30; i++)
+		src.push(packetizer, 64, packets, samples);
+	for (size_t i = 1; i < packets.size(); i++)
+		ASIO_CHECK(packets[i].frames == 480);
+	packets.erase(packets.begin());
+	samples.erase(samples.begin(), samples.begin() + 320);
+	checkContinuous(src, packets, samples, 1280);
+}
+
+/* A period lost on the way: no packet spans the gap, and the stamps after it are those of the new periods. */
+ASIO_TEST(packet_discontinuity)
+{
+	ASIOPacketizer packetizer;
+	packetizer.reset(2, 480);
+	NumberedPeriods src;
+	std::vector<ASIOPacket> packets;
+	std::vector<float> samples;
+	for (int i = 0; i < 10; i++)
+		src.push(packetizer, 128, packets, samples);
+	// 1280 frames: 2 packets and 320 frames pending, then a period goes missing
+	ASIO_CHECK(packets.size() == 2);
+	src.position += 128;
+	packets.clear();
+	samples.clear();
+	src.push(packetizer, 128, packets, samples);
+	ASIO_CHECK(packets.size() == 1 && packets[0].frames == 320 && samples[0] == 960.0f);
+	for (int i = 0; i < 20; i++)
+		src.push(packetizer, 128, packets, samples);
+	packets.erase(packets.begin());
+	samples.erase(samples.begin(), samples.begin() + 320);
+	checkContinuous(src, packets, samples, 1408);
+
+	// jitter of a few microseconds is no discontinuity
+	packetizer.reset(2, 480);
+	packets.clear();
+	samples.clear();
+	const int64_t first = src.position;
+	for (int i = 0; i < 40; i++) {
+		src.start += i % 2 ? 50000 : -50000;
+		src.push(packetizer, 128, packets, samples);
+	}
+	for (const ASIOPacket &packet : packets)
+		ASIO_CHECK(packet.frames == 480);
+	ASIO_CHECK(packets.size() == 40 * 128 / 480 && samples[0] == (float)first);
+}
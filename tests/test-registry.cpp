@@ -0,0 +1,274 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include "asio-registry.hpp"
+#include "asio-test.hpp"
+
+using namespace std::chrono;
+
+/* Stands for HKLM\SOFTWARE\ASIO: the test edits the list and every edit is reported as a change. */
+class FakeDriverSource : public ASIODriverSource {
+public:
+	void set(const std::vector<AsioDriver> &list)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		drivers = list;
+		pending = true;
+		cv.notify_all();
+	}
+
+	bool enumerate(std::vector<AsioDriver> &list) override
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		list = drivers;
+		enumerations++;
+		return true;
+	}
+
+	bool waitForChange() override
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		waiting = true;
+		cv.notify_all();
+		cv.wait(lock, [this]() { return pending || cancelled; });
+		waiting = false;
+		pending = false;
+		return !cancelled;
+	}
+
+	void cancel() override
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+		cv.notify_all();
+	}
+
+	/* Waits until the watcher blocks in waitForChange(); false after a second. */
+	bool waitUntilWaiting()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return cv.wait_for(lock, seconds(1), [this]() { return waiting; });
+	}
+
+	std::atomic<int> enumerations{0};
+
+private:
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<AsioDriver> drivers;
+	bool pending = false;
+	bool cancelled = false;
+	bool waiting = false;
+};
+
+static const AsioDriver focusrite = {"Focusrite USB ASIO", "{8C5E0F8A-6E1C-4B0F-9A6F-5F0B1C2D3E4F}"};
+static const AsioDriver asio4all = {"ASIO4ALL v2", "{232685C6-6548-49D8-846D-4141A3EF7560}"};
+static const AsioDriver rme = {"ASIO Fireface USB", "{A1B2C3D4-0000-1111-2222-333344445555}"};
+
+/* Unplugging an interface keeps its index; plugging it back in gives the same index. */
+ASIO_TEST(registry_hotplug)
+{
+	auto owned = std::make_unique<FakeDriverSource>();
+	FakeDriverSource *source = owned.get();
+	ASIODriverRegistry registry(std::move(owned));
+	ASIO_CHECK(registry.generation() == 0);
+	ASIO_CHECK(registry.indexOf(focusrite.name) == -1);
+
+	source->set({focusrite, asio4all});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.generation() == 1);
+	ASIO_CHECK(registry.indexOf(focusrite.name) == 0);
+	ASIO_CHECK(registry.indexOf(asio4all.name) == 1);
+	ASIO_CHECK(registry.names() == std::vector<std::string>({focusrite.name, asio4all.name}));
+
+	// nothing changed: same generation
+	ASIO_CHECK(!registry.rescan());
+	ASIO_CHECK(registry.generation() == 1);
+
+	// unplugged: absent, index kept
+	source->set({asio4all});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.generation() == 2);
+	AsioDriver driver;
+	ASIO_CHECK(!registry.get(0, driver));
+	ASIO_CHECK(registry.indexOf(focusrite.name) == 0);
+	ASIO_CHECK(registry.indexOfClsid(focusrite.clsid) == 0);
+	ASIO_CHECK(registry.generationOf(0) == 2);
+	ASIO_CHECK(registry.generationOf(1) == 1);
+	ASIO_CHECK(registry.names() == std::vector<std::string>({asio4all.name}));
+
+	// another driver installed meanwhile takes the next index
+	source->set({asio4all, rme});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.indexOf(rme.name) == 2);
+
+	// plugged back in, listed in another order: same index
+	source->set({rme, focusrite, asio4all});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.generation() == 4);
+	ASIO_CHECK(registry.indexOf(focusrite.name) == 0);
+	ASIO_CHECK(registry.get(0, driver) && driver.clsid == focusrite.clsid);
+	ASIO_CHECK(registry.generationOf(0) == 4);
+	ASIO_CHECK(registry.generationOf(2) == 3);
+	ASIO_CHECK(registry.names() == std::vector<std::string>({focusrite.name, asio4all.name, rme.name}));
+	ASIO_CHECK(registry.generationOf(3) == 0 && registry.generationOf(-1) == 0);
+}
+
+/* A driver update may register another class id under the same name, or rename the driver of a class id. */
+ASIO_TEST(registry_clsid_change)
+{
+	auto owned = std::make_unique<FakeDriverSource>();
+	FakeDriverSource *source = owned.get();
+	ASIODriverRegistry registry(std::move(owned));
+	source->set({focusrite, asio4all});
+	registry.rescan();
+
+	// class ids are looked up in any letter case
+	auto lower = [](std::string clsid) {
+		for (char &c : clsid)
+			c = (char)tolower((unsigned char)c);
+		return clsid;
+	};
+	ASIO_CHECK(registry.indexOfClsid(lower(focusrite.clsid)) == 0);
+
+	// same name, new class id: same index, the old class id is gone
+	const AsioDriver updated = {focusrite.name, rme.clsid};
+	source->set({updated, asio4all});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.generation() == 2);
+	ASIO_CHECK(registry.generationOf(0) == 2 && registry.generationOf(1) == 1);
+	ASIO_CHECK(registry.indexOf(focusrite.name) == 0);
+	ASIO_CHECK(registry.indexOfClsid(focusrite.clsid) == -1);
+	ASIO_CHECK(registry.indexOfClsid(rme.clsid) == 0);
+	AsioDriver driver;
+	ASIO_CHECK(registry.get(0, driver) && driver.clsid == rme.clsid);
+
+	// rewritten in another letter case: still the same class id and index
+	const AsioDriver relettered = {focusrite.name, lower(rme.clsid)};
+	source->set({relettered, asio4all});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.indexOfClsid(rme.clsid) == 0);
+
+	// renamed, same class id: a new name index, but the class id keeps the index of the first name
+	const AsioDriver renamed = {"Focusrite USB ASIO (2)", rme.clsid};
+	source->set({renamed, asio4all});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.indexOf(renamed.name) == 2);
+	ASIO_CHECK(registry.indexOfClsid(rme.clsid) == 0);
+	ASIO_CHECK(!registry.get(0, driver));
+	ASIO_CHECK(registry.get(2, driver) && driver.name == renamed.name);
+
+	// and back: the first name is present again under the same index
+	source->set({updated, asio4all});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.get(0, driver) && registry.indexOfClsid(rme.clsid) == 0);
+}
+
+/* Two registry keys with the same description: the first listed wins, the other is ignored. */
+ASIO_TEST(registry_duplicate_name)
+{
+	auto owned = std::make_unique<FakeDriverSource>();
+	FakeDriverSource *source = owned.get();
+	ASIODriverRegistry registry(std::move(owned));
+	const AsioDriver twin = {focusrite.name, asio4all.clsid};
+	source->set({focusrite, twin, rme});
+	ASIO_CHECK(registry.rescan());
+	ASIO_CHECK(registry.names() == std::vector<std::string>({focusrite.name, rme.name}));
+	ASIO_CHECK(registry.indexOf(rme.name) == 1);
+	ASIO_CHECK(registry.indexOfClsid(twin.clsid) == -1);
+	AsioDriver driver;
+	ASIO_CHECK(registry.get(0, driver) && driver.clsid == focusrite.clsid);
+
+	// the duplicate does not count as a change, nor does it make the first one absent
+	ASIO_CHECK(!registry.rescan());
+	source->set({focusrite, rme, twin});
+	ASIO_CHECK(!registry.rescan());
+	ASIO_CHECK(registry.get(0, driver) && driver.clsid == focusrite.clsid);
+}
+
+/* The watcher rescans on every change, while other threads read the registry, and stops at once when asked. */
+ASIO_TEST(registry_watch)
+{
+	auto owned = std::make_unique<FakeDriverSource>();
+	FakeDriverSource *source = owned.get();
+	ASIODriverRegistry registry(std::move(owned));
+	source->set({asio4all});
+	registry.rescan();
+	registry.watch();
+	registry.watch(); // a single watcher
+	ASIO_CHECK(source->waitUntilWaiting());
+
+	std::atomic<bool> stop{false};
+	std::atomic<int> reads{0};
+	std::thread reader([&]() {
+		AsioDriver driver;
+		while (!stop) {
+			const int index = registry.indexOf(focusrite.name);
+			if (registry.get(index, driver))
+				ASIO_CHECK(driver.name == focusrite.name);
+			registry.names();
+			registry.generationOf(index);
+			reads++;
+		}
+	});
+
+	// plugged and unplugged a few times: every change is picked up without a call to rescan()
+	for (int i = 0; i < 10; i++) {
+		const uint64_t before = registry.generation();
+		source->set(i % 2 ? std::vector<AsioDriver>{asio4all} : std::vector<AsioDriver>{asio4all, focusrite});
+		const auto deadline = steady_clock::now() + seconds(2);
+		while (registry.generation() == before && steady_clock::now() < deadline)
+			std::this_thread::sleep_for(milliseconds(1));
+		ASIO_CHECK_MSG(registry.generation() == before + 1, "change %d not picked up", i);
+	}
+	ASIO_CHECK(registry.indexOf(focusrite.name) == 1);
+	stop = true;
+	reader.join();
+	ASIO_CHECK(reads > 0);
+
+	// the watcher is blocked waiting for a change: unwatch() must cancel the wait rather than hang
+	ASIO_CHECK(source->waitUntilWaiting());
+	const auto before = steady_clock::now();
+	registry.unwatch();
+	const double ms = duration<double, std::milli>(steady_clock::now() - before).count();
+	ASIO_CHECK_MSG(ms < 500.0, "unwatch took %.0f ms", ms);
+	registry.unwatch();
+
+	// no more rescans once unwatched
+	const int enumerations = source->enumerations;
+	source->set({});
+	std::this_thread::sleep_for(milliseconds(20));
+	ASIO_CHECK(source->enumerations == enumerations);
+	ASIO_CHECK(registry.names() == std::vector<std::string>({asio4all.name}));
+}
+
+/* Destroying a watched registry stops the watcher first. */
+ASIO_TEST(registry_watch_destroy)
+{
+	auto owned = std::make_unique<FakeDriverSource>();
+	FakeDriverSource *source = owned.get();
+	{
+		ASIODriverRegistry registry(std::move(owned));
+		registry.watch();
+		ASIO_CHECK(source->waitUntilWaiting());
+		// a change is pending or being scanned as the registry goes away
+		source->set({focusrite});
+	}
+}
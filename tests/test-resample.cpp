@@ -0,0 +1,137 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cmath>
+#include "asio-resample.hpp"
+#include "asio-test.hpp"
+
+static const double pi = 3.14159265358979323846;
+
+struct ResampleRates {
+	int in, out;
+};
+
+static const ResampleRates resampleRates[] = {{44100, 48000}, {48000, 44100}, {96000, 48000},
+					      {48000, 96000}, {192000, 48000}, {32000, 48000}};
+
+/* Resamples one second of a sine of freq Hz in blocks of block frames, as the device does for each period. */
+static std::vector<float> resampleSine(const ASIOResampleFilter &filter, double freq, int block)
+{
+	const int frames = filter.inRate;
+	std::vector<float> in(frames), out((size_t)filter.maxOutput(frames) + 1);
+	for (int i = 0; i < frames; i++)
+		in[i] = (float)(0.5 * std::sin(2.0 * pi * freq * i / filter.inRate));
+
+	ASIOResampler resampler(std::make_shared<const ASIOResampleFilter>(filter), block);
+	int produced = 0;
+	for (int done = 0; done < frames; done += block) {
+		const int n = std::min(block, frames - done);
+		produced += resampler.process(in.data() + done, n, out.data() + produced);
+	}
+	out.resize(produced);
+	return out;
+}
+
+/* Least squares fit of a sine of freq Hz to the output past the filter delay; returns its amplitude, and the rms of
+ * the residual.
+ */
+static double fitSine(const std::vector<float> &out, int rate, double freq, double &residual)
+{
+	const size_t first = out.size() / 10, last = out.size() - out.size() / 10;
+	double ss = 0.0, cc = 0.0, sc = 0.0, ys = 0.0, yc = 0.0;
+	for (size_t i = first; i < last; i++) {
+		const double s = std::sin(2.0 * pi * freq * i / rate), c = std::cos(2.0 * pi * freq * i / rate);
+		ss += s * s;
+		cc += c * c;
+		sc += s * c;
+		ys += out[i] * s;
+		yc += out[i] * c;
+	}
+	const double det = ss * cc - sc * sc;
+	const double a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+	double sum = 0.0;
+	for (size_t i = first; i < last; i++) {
+		const double phase = 2.0 * pi * freq * i / rate;
+		const double e = out[i] - a * std::sin(phase) - b * std::cos(phase);
+		sum += e * e;
+	}
+	residual = std::sqrt(sum / (double)(last - first));
+	return std::sqrt(a * a + b * b);
+}
+
+ASIO_TEST(resample_snr)
+{
+	for (const ResampleRates &r : resampleRates) {
+		const ASIOResampleFilter filter(r.in, r.out);
+		ASIO_CHECK(filter.valid());
+		for (int block : {64, 441, 512}) {
+			const std::vector<float> out = resampleSine(filter, 997.0, block);
+			// every input frame is accounted for, whatever the block size
+			ASIO_CHECK_MSG(std::abs((int)out.size() - r.out) <= 1, "%d to %d: %d frames", r.in, r.out,
+				       (int)out.size());
+			double residual;
+			const double amplitude = fitSine(out, r.out, 997.0, residual);
+			const double snr = 20.0 * std::log10(amplitude / std::sqrt(2.0) / residual);
+			ASIO_CHECK_MSG(snr > 100.0, "%d to %d, %d frames blocks: snr %.1f dB", r.in, r.out, block, snr);
+		}
+	}
+}
+
+/* Flat up to 90% of the lower Nyquist frequency, attenuated past the output Nyquist frequency. */
+ASIO_TEST(resample_response)
+{
+	for (const ResampleRates &r : resampleRates) {
+		const ASIOResampleFilter filter(r.in, r.out);
+		const double nyquist = std::min(r.in, r.out) / 2.0;
+		for (double f : {100.0, 0.5 * nyquist, 0.9 * nyquist}) {
+			const std::vector<float> out = resampleSine(filter, f, 512);
+			double residual;
+			const double db = 20.0 * std::log10(fitSine(out, r.out, f, residual) / 0.5);
+			ASIO_CHECK_MSG(std::fabs(db) < 0.05, "%d to %d: %.3f dB at %.0f Hz", r.in, r.out, db, f);
+		}
+		if (r.out >= r.in)
+			continue;
+		// would alias back into the audible band
+		for (double f : {1.05 * nyquist, 0.95 * r.in / 2.0}) {
+			const std::vector<float> out = resampleSine(filter, f, 512);
+			double sum = 0.0;
+			for (size_t i = out.size() / 10; i < out.size(); i++)
+				sum += (double)out[i] * out[i];
+			const double rms = std::sqrt(sum / (double)(out.size() - out.size() / 10));
+			const double db = 20.0 * std::log10(rms * std::sqrt(2.0) / 0.5);
+			ASIO_CHECK_MSG(db < -85.0, "%d to %d: %.1f dB at %.0f Hz", r.in, r.out, db, f);
+		}
+	}
+}
+
+/* A skipped channel stays in step with the processed ones. */
+ASIO_TEST(resample_skip)
+{
+	for (int inRate : {44100, 96000, 192000}) {
+		auto filter = std::make_shared<const ASIOResampleFilter>(inRate, 48000);
+		ASIOResampler processed(filter, 256), skipped(filter, 256);
+		std::vector<float> in(256, 0.25f), out((size_t)filter->maxOutput(256));
+		int mismatches = 0;
+		for (int i = 0; i < 1000; i++) {
+			const int n = 1 + (i * 37) % 256;
+			mismatches += processed.process(in.data(), n, out.data()) != skipped.skip(n) ? 1 : 0;
+		}
+		ASIO_CHECK_MSG(mismatches == 0, "%d Hz: %d blocks out of step", inRate, mismatches);
+	}
+	ASIO_CHECK(!ASIOResampleFilter(44100, 48001).valid());
+}
@@ -0,0 +1,179 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * Channel masks and the driver to delivery thread ring; run under the thread sanitizer too.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "asio-ring.hpp"
+#include "asio-test.hpp"
+
+ASIO_TEST(ring_mask)
+{
+	ASIOChannelMask mask, other;
+	mask.resize(130);
+	mask.set(0);
+	mask.set(63);
+	mask.set(64);
+	mask.set(129);
+	mask.set(200); // past the last word, ignored
+	ASIO_CHECK(mask.test(0) && mask.test(63) && mask.test(64) && mask.test(129));
+	ASIO_CHECK(!mask.test(1) && !mask.test(128) && !mask.test(200));
+
+	std::vector<int> seen;
+	mask.forEach([&](int i) { seen.push_back(i); });
+	ASIO_CHECK((seen == std::vector<int>{0, 63, 64, 129}));
+
+	other.resize(64);
+	other.set(63);
+	mask.remove(other);
+	ASIO_CHECK(!mask.test(63) && mask.test(64));
+
+	// truncated to the 64 channels of other
+	other.assign(mask);
+	ASIO_CHECK(other.test(0) && !other.test(63) && !other.test(64));
+	mask.clear();
+	seen.clear();
+	mask.forEach([&](int i) { seen.push_back(i); });
+	ASIO_CHECK(seen.empty());
+}
+
+ASIO_TEST(ring_capacity)
+{
+	ASIOBlockRing ring;
+	ASIO_CHECK(!ring.beginWrite() && !ring.beginRead());
+
+	// rounded up to 8 slots
+	ring.resize(5, 2, 64);
+	for (int i = 0; i < 8; i++) {
+		ASIOAudioBlock *block = ring.beginWrite();
+		ASIO_CHECK(block != nullptr);
+		if (!block)
+			return;
+		block->timestamp = i;
+		ring.endWrite();
+	}
+	ASIO_CHECK(!ring.beginWrite());
+	for (int i = 0; i < 8; i++) {
+		ASIO_CHECK(!ring.drained());
+		ASIOAudioBlock *block = ring.beginRead();
+		ASIO_CHECK(block && block->timestamp == (uint64_t)i);
+		ring.endRead();
+	}
+	ASIO_CHECK(!ring.beginRead() && ring.drained());
+	ASIO_CHECK(ring.channel(*ring.beginWrite(), 1) - ring.channel(*ring.beginWrite(), 0) == 64);
+}
+
+/* A producer writing as fast as it can against a slower consumer: every period is either delivered whole and in
+ * order or counted as dropped, never torn.
+ */
+ASIO_TEST(ring_threads)
+{
+	const int periods = 100000, channels = 4, frames = 32;
+	ASIOBlockRing ring;
+	ring.resize(8, channels, frames);
+	std::atomic<bool> done{false};
+	int dropped = 0, received = 0, errors = 0;
+
+	std::thread consumer([&]() {
+		uint64_t last = 0;
+		for (;;) {
+			const bool finished = done.load();
+			while (ASIOAudioBlock *block = ring.beginRead()) {
+				const uint64_t seq = block->timestamp;
+				if (seq <= last || block->frames != frames || !block->routed.test((int)(seq % channels)))
+					errors++;
+				for (int c = 0; c < channels; c++)
+					for (int i = 0; i < frames; i++)
+						errors += ring.channel(*block, c)[i] != (float)(seq + c) ? 1 : 0;
+				last = seq;
+				received++;
+				ring.endRead();
+			}
+			if (finished)
+				break;
+			std::this_thread::yield();
+		}
+	});
+
+	for (int seq = 1; seq <= periods; seq++) {
+		ASIOAudioBlock *block = ring.beginWrite();
+		if (!block) {
+			dropped++;
+			continue;
+		}
+		for (int c = 0; c < channels; c++)
+			for (int i = 0; i < frames; i++)
+				ring.channel(*block, c)[i] = (float)(seq + c);
+		block->frames = frames;
+		block->routed.clear();
+		block->routed.set(seq % channels);
+		block->timestamp = seq;
+		ring.endWrite();
+		// a period's worth of time for the consumer, now and then; even on a single core
+		if (seq % 4 == 0)
+			std::this_thread::yield();
+	}
+	done = true;
+	consumer.join();
+	ASIO_CHECK(errors == 0);
+	ASIO_CHECK_MSG(received + dropped == periods, "%d received, %d dropped", received, dropped);
+	ASIO_CHECK_MSG(received > periods / 100, "%d received", received);
+}
+
+/* Readers always see a whole snapshot, never a freed one, while a writer keeps replacing it. */
+ASIO_TEST(ring_snapshot)
+{
+	struct Snapshot {
+		std::vector<int> values;
+		explicit Snapshot(int version) : values(64, version) {}
+		~Snapshot() { std::fill(values.begin(), values.end(), -1); }
+	};
+
+	const int versions = 2000;
+	ASIOSnapshotPtr<Snapshot> snapshot(new Snapshot(0));
+	std::atomic<bool> done{false};
+	std::atomic<int> errors{0};
+
+	auto reader = [&]() {
+		int last = 0;
+		while (!done.load()) {
+			const int epoch = snapshot.enter();
+			const Snapshot *s = snapshot.get();
+			const int version = s->values[0];
+			// let the writer run while we hold the snapshot
+			std::this_thread::yield();
+			for (int v : s->values)
+				errors += v != version ? 1 : 0;
+			// versions only move forward
+			errors += version < last ? 1 : 0;
+			last = version;
+			snapshot.leave(epoch);
+		}
+	};
+	std::thread first(reader), second(reader);
+
+	for (int version = 1; version <= versions; version++) {
+		snapshot.publish(new Snapshot(version));
+	}
+	done = true;
+	first.join();
+	second.join();
+	ASIO_CHECK(errors == 0);
+	ASIO_CHECK(snapshot.get()->values[0] == versions);
+}
@@ -0,0 +1,175 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <cmath>
+#include <random>
+#include "asio-test.hpp"
+#include "asio-timing.hpp"
+
+/* A device whose clock runs at rate (frames per second of the obs clock) and whose callbacks are woken up late by a
+ * random latency, mostly under 300 us with a few 2 ms outliers.
+ */
+struct JitteryDevice {
+	double rate;
+	int frames;
+	int64_t position = 0;
+	double ideal = 1e9; // obs time (ns) at which the current period ends
+	std::mt19937 rng{7};
+
+	JitteryDevice(double deviceRate, int periodFrames) : rate(deviceRate), frames(periodFrames) {}
+
+	/* Next period: returns the time its callback runs, ideal is then the time it should be stamped with. */
+	uint64_t next()
+	{
+		position += frames;
+		ideal += frames * 1e9 / rate;
+		std::uniform_real_distribution<double> latency(0.0, 300e3);
+		const double late = rng() % 200 == 0 ? 2e6 : latency(rng);
+		return (uint64_t)(ideal + late);
+	}
+};
+
+/* Deviation of the stamps from the ideal times once the loop settled, without the constant offset (the mean wake-up
+ * latency, which a loop cannot know about).
+ */
+struct Deviation {
+	double sum = 0.0, sumSquares = 0.0, low = 1e300, high = -1e300;
+	int count = 0;
+
+	void add(double d)
+	{
+		sum += d;
+		sumSquares += d * d;
+		low = std::fmin(low, d);
+		high = std::fmax(high, d);
+		count++;
+	}
+	double mean() const { return sum / count; }
+	double stddev() const { return std::sqrt(sumSquares / count - mean() * mean()); }
+	double range() const { return high - low; }
+};
+
+ASIO_TEST(timing_jitter)
+{
+	for (int frames : {64, 256, 1024}) {
+		const double nominal = 48000.0;
+		JitteryDevice device(nominal * (1.0 + 100e-6), frames);
+		ASIOClockDLL dll(1.0);
+		dll.reset(nominal);
+
+		Deviation in, out, ppm;
+		uint64_t last = 0;
+		int backwards = 0;
+		const int settle = (int)(10.0 * nominal / frames), periods = settle * 3;
+		for (int i = 0; i < periods; i++) {
+			const uint64_t now = device.next();
+			const uint64_t ts = dll.update(device.position, now);
+			backwards += ts <= last ? 1 : 0;
+			last = ts;
+			if (i >= settle) {
+				in.add((double)now - device.ideal);
+				out.add((double)ts - device.ideal);
+				ppm.add((dll.measuredRate() / device.rate - 1.0) * 1e6);
+			}
+		}
+		ASIO_CHECK_MSG(backwards == 0, "%d frames: %d stamps not increasing", frames, backwards);
+		// the wake-up latency is ~150 us rms with 2 ms outliers. The loop follows the drift as well, so the
+		// longer the periods the less it smooths: at 1 Hz and 1024 frames it is updated 47 times per second.
+		ASIO_CHECK_MSG(out.stddev() < in.stddev() / 2.0, "%d frames: jitter %.1f us rms in, %.1f us out",
+			       frames, in.stddev() / 1e3, out.stddev() / 1e3);
+		ASIO_CHECK_MSG(out.range() < in.range() / 3.0, "%d frames: jitter %.1f us peak in, %.1f us out",
+			       frames, in.range() / 1e3, out.range() / 1e3);
+		// the estimate of each period is noisy, their mean must match the drift of the device
+		ASIO_CHECK_MSG(std::fabs(ppm.mean()) < 5.0, "%d frames: rate off by %.1f ppm", frames, ppm.mean());
+	}
+}
+
+/* The device clock drifting away (e.g. a word clock change): the rate estimate follows within a few seconds. */
+ASIO_TEST(timing_rate_change)
+{
+	const double nominal = 48000.0;
+	JitteryDevice device(nominal, 128);
+	ASIOClockDLL dll(1.0);
+	dll.reset(nominal);
+
+	const int second = (int)(nominal / 128);
+	for (int i = 0; i < 10 * second; i++)
+		dll.update(device.position, device.next());
+	device.rate = nominal * (1.0 - 500e-6);
+	Deviation ppm;
+	uint64_t last = 0;
+	int backwards = 0;
+	for (int i = 0; i < 10 * second; i++) {
+		const uint64_t ts = dll.update(device.position, device.next());
+		backwards += ts <= last ? 1 : 0;
+		last = ts;
+		if (i >= 5 * second)
+			ppm.add((dll.measuredRate() / device.rate - 1.0) * 1e6);
+	}
+	ASIO_CHECK_MSG(std::fabs(ppm.mean()) < 5.0, "rate off by %.1f ppm", ppm.mean());
+	ASIO_CHECK(backwards == 0);
+}
+
+/* A jump of the sample position (driver resync) relocks on the callback time without going backwards. */
+ASIO_TEST(timing_relock)
+{
+	const double nominal = 44100.0;
+	JitteryDevice device(nominal, 256);
+	ASIOClockDLL dll(1.0);
+	dll.reset(nominal);
+
+	uint64_t last = 0;
+	for (int i = 0; i < 2000; i++)
+		last = dll.update(device.position, device.next());
+
+	// the position restarts from 0 while the time goes on
+	device.position = -256;
+	const uint64_t now = device.next();
+	const uint64_t ts = dll.update(device.position, now);
+	ASIO_CHECK(ts > last);
+	ASIO_CHECK_MSG(ts <= now, "relocked %.1f us after the callback", ((double)ts - (double)now) / 1e3);
+
+	// a stalled driver: the next callback comes 1 s late
+	device.ideal += 1e9;
+	const uint64_t late = device.next();
+	const uint64_t stamped = dll.update(device.position, late);
+	ASIO_CHECK(stamped > ts);
+	ASIO_CHECK_MSG(std::fabs((double)stamped - (double)late) < 1e6, "stamped %.1f ms away from the callback",
+		       ((double)stamped - (double)late) / 1e6);
+}
+
+/* Periods longer than 100 ms, e.g. 6400 frames at 48 kHz: every callback moves the position by a period, which is no
+ * discontinuity. The loop must stay locked and follow the drift rather than relock on each one.
+ */
+ASIO_TEST(timing_long_period)
+{
+	const double nominal = 48000.0;
+	const int frames = 6400;
+	JitteryDevice device(nominal * (1.0 + 100e-6), frames);
+	ASIOClockDLL dll(1.0);
+	dll.reset(nominal, frames);
+
+	Deviation ppm;
+	const int settle = (int)(20.0 * nominal / frames), periods = settle * 4;
+	for (int i = 0; i < periods; i++) {
+		dll.update(device.position, device.next());
+		if (i >= settle)
+			ppm.add((dll.measuredRate() / device.rate - 1.0) * 1e6);
+	}
+	// relocking on every callback would stamp the callback times as they are, and keep the nominal rate
+	ASIO_CHECK_MSG(std::fabs(ppm.mean()) < 20.0, "rate off by %.1f ppm", ppm.mean());
+}
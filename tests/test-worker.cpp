@@ -0,0 +1,282 @@
+/*  Copyright (c) 2024 pkv <pkv@obsproject.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <vector>
+#include "asio-stats.hpp"
+#include "asio-test.hpp"
+#include "fake-driver.hpp"
+
+using namespace std::chrono;
+
+/* Adding a source must not wait for a driver taking 300 ms to start. */
+ASIO_TEST(worker_open_async)
+{
+	FakeDriver driver;
+	driver.startDelay = milliseconds(300);
+	ASIODeviceWorker worker(driver);
+	worker.start();
+
+	std::atomic<bool> done{false};
+	const auto before = steady_clock::now();
+	std::shared_future<std::string> result = worker.openAsync(0, 0, [&](const std::string &err) {
+		ASIO_CHECK(err.empty());
+		done = true;
+	});
+	const double us = duration<double, std::micro>(steady_clock::now() - before).count();
+	ASIO_CHECK_MSG(us < 1000.0, "openAsync took %.0f us", us);
+	ASIO_CHECK(worker.getState() == ASIODeviceState::opening);
+
+	// a second source asking meanwhile shares the pending open
+	std::shared_future<std::string> shared = worker.openAsync(0, 0);
+	ASIO_CHECK(result.get().empty() && shared.get().empty());
+	ASIO_CHECK(done);
+	ASIO_CHECK(worker.getState() == ASIODeviceState::running);
+	ASIO_CHECK(driver.opens == 1);
+
+	// a failed open is retried by the next one
+	worker.closeAsync().get();
+	driver.startDelay = milliseconds(0);
+	driver.openError = "no clock";
+	ASIO_CHECK(worker.openAsync(0, 0).get() == "no clock");
+	ASIO_CHECK(worker.getState() == ASIODeviceState::failed);
+	driver.openError.clear();
+	ASIO_CHECK(worker.openAsync(0, 0).get().empty());
+	ASIO_CHECK(worker.getState() == ASIODeviceState::running);
+
+	worker.stop();
+	ASIO_CHECK(driver.misplaced == 0);
+}
+
+/* The last source goes away and another one comes before the worker got to the close. */
+ASIO_TEST(worker_close_then_open)
+{
+	FakeDriver driver;
+	driver.clients = 1;
+	ASIODeviceWorker worker(driver);
+	worker.start();
+	ASIO_CHECK(worker.openAsync(0, 0).get().empty());
+
+	// keeps the worker busy while the sources come and go
+	std::promise<void> gate;
+	std::shared_future<void> opened = gate.get_future().share();
+	worker.post([opened]() { opened.wait(); });
+
+	driver.clients = 0;
+	std::future<void> closed = worker.closeAsync();
+	ASIO_CHECK(worker.getState() == ASIODeviceState::closing);
+	driver.clients = 1;
+	std::shared_future<std::string> reopened = worker.openAsync(0, 0);
+	ASIO_CHECK(worker.getState() == ASIODeviceState::opening);
+	gate.set_value();
+	closed.get();
+	ASIO_CHECK(reopened.get().empty());
+	// the close was skipped, the driver kept running
+	ASIO_CHECK(driver.closes == 0);
+	ASIO_CHECK(driver.open);
+	ASIO_CHECK(worker.getState() == ASIODeviceState::running);
+
+	// closed for good once the last source is gone
+	driver.clients = 0;
+	worker.closeAsync().get();
+	ASIO_CHECK(driver.closes == 1 && !driver.open);
+	ASIO_CHECK(worker.getState() == ASIODeviceState::closed);
+	worker.stop();
+	ASIO_CHECK(driver.misplaced == 0);
+}
+
+/* Sources opening and closing the device from several threads: the driver calls never overlap, and the device ends
+ * up in the state the last request asked for.
+ */
+ASIO_TEST(worker_concurrent)
+{
+	FakeDriver driver;
+	driver.startDelay = milliseconds(1);
+	ASIODeviceWorker worker(driver);
+	worker.start();
+
+	std::vector<std::thread> sources;
+	for (int t = 0; t < 4; t++) {
+		sources.emplace_back([&worker, &driver, t]() {
+			for (int i = 0; i < 50; i++) {
+				if ((i + t) % 3) {
+					driver.clients++;
+					worker.openAsync(0, 0);
+				} else {
+					driver.clients--;
+					worker.closeAsync();
+				}
+			}
+		});
+	}
+	for (std::thread &source : sources)
+		source.join();
+
+	driver.clients = 0;
+	worker.closeAsync().get();
+	ASIO_CHECK(worker.getState() == ASIODeviceState::closed && !driver.open);
+	driver.clients = 1;
+	ASIO_CHECK(worker.openAsync(0, 0).get().empty());
+	ASIO_CHECK(worker.getState() == ASIODeviceState::running && driver.open);
+	worker.stop();
+	ASIO_CHECK(driver.misplaced == 0);
+}
+
+/* A burst of 100 reset messages within 10 ms ends in a single reopen, and never blocks the thread sending them. */
+ASIO_TEST(worker_reset_debounce)
+{
+	FakeDriver driver;
+	driver.clients = 1;
+	ASIODeviceWorker worker(driver);
+	worker.start();
+	ASIO_CHECK(worker.openAsync(0, 0).get().empty());
+
+	const auto delay = milliseconds(50);
+	double slowest = 0.0;
+	const auto burst = steady_clock::now();
+	for (int i = 0; i < 100; i++) {
+		const auto before = steady_clock::now();
+		worker.scheduleReset(delay);
+		slowest = std::max(slowest, duration<double, std::micro>(steady_clock::now() - before).count());
+		std::this_thread::sleep_until(burst + microseconds(100 * (i + 1)));
+	}
+	ASIO_CHECK_MSG(slowest < 1000.0, "scheduleReset took %.0f us", slowest);
+	ASIO_CHECK(driver.reopens == 0);
+
+	// well past the countdown restarted by the last message
+	std::this_thread::sleep_for(delay * 4);
+	ASIO_CHECK_MSG(driver.reopens == 1, "%d reopens", driver.reopens.load());
+	ASIO_CHECK(worker.getState() == ASIODeviceState::running);
+
+	// a reset cancelled before it is due does not happen
+	worker.scheduleReset(delay);
+	worker.cancelReset();
+	std::this_thread::sleep_for(delay * 2);
+	ASIO_CHECK(driver.reopens == 1);
+	worker.stop();
+	ASIO_CHECK(driver.misplaced == 0);
+}
+
+/* Fake driver streaming 5 ms periods on its own thread. The callback and the reopen keep the books the way
+ * ASIOAudioIODevice::processBuffer() and reopenDriver() do: the reopen notes the end of the last period, and the first
+ * period after it records the gap.
+ */
+class StreamingDriver : public FakeDriver {
+public:
+	const uint64_t periodNs = 5000000;
+	ASIODeviceStats stats;
+	std::atomic<int> periods{0};
+
+	~StreamingDriver() { stopStream(); }
+
+	std::string openDriver(double sampleRate, int bufferSize) override
+	{
+		const std::string err = FakeDriver::openDriver(sampleRate, bufferSize);
+		if (err.empty())
+			startStream();
+		return err;
+	}
+
+	void closeDriver() override
+	{
+		stopStream();
+		FakeDriver::closeDriver();
+	}
+
+	std::string reopenDriver() override
+	{
+		// close(): the sources stay attached
+		stopStream();
+		if (lastCallbackStart)
+			reopenFrom = lastCallbackStart + periodNs;
+		// open(): the driver takes startDelay to start again
+		const std::string err = FakeDriver::reopenDriver();
+		startStream();
+		return err;
+	}
+
+private:
+	std::thread stream;
+	std::atomic<bool> streaming{false};
+	uint64_t lastCallbackStart = 0; // stream thread, and worker while the stream is stopped
+	std::atomic<uint64_t> reopenFrom{0};
+
+	static uint64_t now()
+	{
+		return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	void startStream()
+	{
+		stats.reset();
+		lastCallbackStart = 0;
+		streaming = true;
+		stream = std::thread([this]() {
+			while (streaming) {
+				std::this_thread::sleep_for(nanoseconds(periodNs));
+				const uint64_t start = now();
+				if (!lastCallbackStart) {
+					const uint64_t from = reopenFrom.exchange(0, std::memory_order_relaxed);
+					if (from && start > from)
+						stats.recordReopen(start - from);
+				}
+				stats.recordCallback(start, now(), lastCallbackStart, periodNs);
+				lastCallbackStart = start;
+				periods++;
+			}
+		});
+	}
+
+	void stopStream()
+	{
+		streaming = false;
+		if (stream.joinable())
+			stream.join();
+	}
+};
+
+/* A reopen asked for by the driver keeps its sources and costs the start time of a well-behaved driver, well under
+ * 100 ms. This covers the worker and the gap accounting, not a real driver.
+ */
+ASIO_TEST(worker_reopen_gap)
+{
+	StreamingDriver driver;
+	driver.startDelay = milliseconds(20);
+	driver.clients = 2;
+	ASIODeviceWorker worker(driver);
+	worker.start();
+	ASIO_CHECK(worker.openAsync(0, 0).get().empty());
+	std::this_thread::sleep_for(milliseconds(30));
+
+	worker.scheduleReset(milliseconds(0));
+	while (driver.reopens == 0)
+		std::this_thread::sleep_for(milliseconds(1));
+	while (driver.stats.reopens == 0)
+		std::this_thread::sleep_for(milliseconds(1));
+	const int before = driver.periods;
+	std::this_thread::sleep_for(milliseconds(30));
+
+	ASIO_CHECK(worker.getState() == ASIODeviceState::running);
+	ASIO_CHECK(driver.clients == 2 && driver.closes == 0);
+	ASIO_CHECK_MSG(driver.periods > before, "no audio after the reopen");
+	ASIO_CHECK(driver.stats.reopens == 1);
+	const double gapMs = driver.stats.reopenGap.maximum() / 1000.0;
+	ASIO_CHECK_MSG(gapMs >= 20.0 && gapMs < 100.0, "reopen gap %.1f ms", gapMs);
+	ASIO_CHECK(driver.stats.summary().find(" | reopens 1, gap p50 ") != std::string::npos);
+	worker.stop();
+	ASIO_CHECK(driver.misplaced == 0);
+}